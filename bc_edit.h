@@ -0,0 +1,626 @@
+/* INDEX EDITS
+ * author: Zach Goldthorpe
+ *
+ * The file provides edits to the rows and controllers of a loaded network that
+ * are carried straight into the block-cut tree index [see bc_index.h], so that
+ * the next query answered through the index reflects them without reading the
+ * network or building the index again.
+ *
+ * Only the blocks an edit touches are recomputed:
+ *  - a row joining two trees of the forest adds two bridges between them, the
+ *    smaller tree being rerooted and renumbered below the new pair;
+ *  - a row within one tree merges the blocks on the path between its ends
+ *    (found by climbing from both ends) into a single block;
+ *  - removing a row whose pair cuts its tree splits off the part below it;
+ *  - removing any other row runs Tarjan's algorithm again over the vertices of
+ *    the one block holding its pair, hanging the blocks it finds in its place.
+ * Depths are then only kept increasing from parent to child (which is all the
+ * queries rely on), pushing down only the nodes that would break this.
+ *
+ * The first edit takes a copy of the parent, depth and comp arrays of the
+ * index (which may be mapped from a snapshot) and lays the subdivided network
+ * and the children of the vertices out in two flat arrays; every edit after
+ * that is local, keeping the lists it changes apart from the flat arrays. The
+ * graph and pairs read by traverse() are left as they were, so an edited
+ * network can only be queried through the index. The edits write to the
+ * network [see network.h], so they must all be made before its queries start.
+ *
+ * index_add_row:    add a <u, v> pair to an edge of the indexed network
+ * index_remove_row: remove a <u, v> pair (either way round) of an edge of the
+ *                   indexed network
+ * read_edits:       apply the edits listed in a file
+ */
+
+#ifndef _bc_edit_h_
+#define _bc_edit_h_
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include "read_graph.h"
+#include "bc_index.h"
+
+/* adds a row joining @from to @to through the edge @via to the indexed
+ * network @net, adding any of the three ID's that are new
+ */
+void index_add_row(network &net, const jkey &via, const jkey &from,
+        const jkey &to);
+
+/* removes one row joining @from to @to through the edge @via from the indexed
+ * network @net; as the rows are undirected, a row joining @to to @from is
+ * removed if there is none the same way round
+ *
+ * returns false if there is no such row
+ */
+bool index_remove_row(network &net, const jkey &via, const jkey &from,
+        const jkey &to);
+
+/* applies the edits listed in the text file @filename to the indexed network
+ * @net and to the controller ID's @controllers; each line is one of
+ *     add-row <via> <from> <to>
+ *     remove-row <via> <from> <to>
+ *     add-controller <id>
+ *     remove-controller <id>
+ * with the fields separated by whitespace
+ *
+ * returns false (reporting the line) at the first edit that cannot be applied
+ */
+bool read_edits(network &net, const char *filename,
+        std::vector<std::string> &controllers);
+
+
+// ==== DEFINITIONS ==== //
+
+/* switches the index over to the representation that can be edited
+ */
+static void edit_begin(network &net) {
+    bc_forest &bcindex = net.index;
+    const flat<std::pair<uint32_t, uint32_t> > &edgenodes = net.edgenodes;
+    if (!bcindex.block.empty())
+        return;
+    bcindex.parent.own();
+    bcindex.depth.own();
+    bcindex.comp.own();
+    const std::vector<uint32_t> &parent = bcindex.parent.vec;
+    uint32_t n = bcindex.vertices, real = bcindex.real;
+    bcindex.edit_base = parent.size();
+    bcindex.block.assign(bcindex.edit_base, false);
+    bcindex.edit_vfirst.assign(n+1, 0);
+    for (uint32_t x = n; x < bcindex.edit_base; ++x) {
+        bcindex.block[x] = true;
+        ++bcindex.edit_vfirst[parent[x]+1];
+    }
+    for (uint32_t v = 0; v < n; ++v)
+        bcindex.edit_vfirst[v+1] += bcindex.edit_vfirst[v];
+    bcindex.edit_blocks.resize(bcindex.edit_vfirst[n]);
+    std::vector<uint32_t> fill(bcindex.edit_vfirst.begin(),
+        bcindex.edit_vfirst.end()-1);
+    for (uint32_t x = n; x < bcindex.edit_base; ++x)
+        bcindex.edit_blocks[fill[parent[x]]++] = x;
+
+    // the subdivided network, as in build_index
+    uint32_t pairs = edgenodes.size();
+    bcindex.edit_first.assign(n+1, 0);
+    bcindex.edit_arcs.resize(4*(size_t)pairs);
+    for (uint32_t p = 0; p < pairs; ++p) {
+        ++bcindex.edit_first[edgenodes[p].first+1];
+        ++bcindex.edit_first[edgenodes[p].second+1];
+        bcindex.edit_first[real+p+1] += 2;
+    }
+    for (uint32_t v = 0; v < n; ++v)
+        bcindex.edit_first[v+1] += bcindex.edit_first[v];
+    fill.assign(bcindex.edit_first.begin(), bcindex.edit_first.end()-1);
+    for (uint32_t p = 0; p < pairs; ++p) {
+        uint32_t u = edgenodes[p].first, v = edgenodes[p].second;
+        bcindex.edit_arcs[fill[u]++] = real+p;
+        bcindex.edit_arcs[fill[v]++] = real+p;
+        bcindex.edit_arcs[fill[real+p]++] = u;
+        bcindex.edit_arcs[fill[real+p]++] = v;
+    }
+    for (uint32_t x = 0; x < n; ++x)
+        ++bcindex.edit_size[bcindex.comp[x]];
+    bcindex.edit_mark.assign(bcindex.edit_base, NOPARENT);
+}
+
+/* points the flat arrays of the index at their vectors again
+ */
+static void edit_end(bc_forest &bcindex) {
+    bcindex.parent.sync();
+    bcindex.depth.sync();
+    bcindex.comp.sync();
+}
+
+/* returns a new node of the index, as a root of its own
+ */
+static uint32_t edit_node(bc_forest &bcindex, bool block) {
+    uint32_t x = bcindex.parent.vec.size();
+    bcindex.parent.vec.push_back(NOPARENT);
+    bcindex.depth.vec.push_back(0);
+    bcindex.comp.vec.push_back(x);
+    bcindex.block.push_back(block);
+    bcindex.edit_mark.push_back(NOPARENT);
+    return x;
+}
+
+/* points [@begin, @end) at the children of node @x
+ */
+static void edit_kids(bc_forest &bcindex, uint32_t x, const uint32_t *&begin,
+        const uint32_t *&end) {
+    std::unordered_map<uint32_t, std::vector<uint32_t> >::const_iterator it
+        = bcindex.children.find(x);
+    if (it != bcindex.children.end()) {
+        begin = it->second.data();
+        end = begin + it->second.size();
+    } else if (x < bcindex.vertices) {
+        begin = bcindex.edit_blocks.data() + bcindex.edit_vfirst[x];
+        end = bcindex.edit_blocks.data() + bcindex.edit_vfirst[x+1];
+    } else if (x < bcindex.edit_base) {
+        index_children(bcindex, x, begin, end);
+    } else {
+        begin = end = nullptr;
+    }
+}
+
+/* returns the children of node @x, to be modified
+ */
+static std::vector<uint32_t> &edit_children(bc_forest &bcindex, uint32_t x) {
+    std::unordered_map<uint32_t, std::vector<uint32_t> >::iterator it
+        = bcindex.children.find(x);
+    if (it != bcindex.children.end())
+        return it->second;
+    const uint32_t *begin, *end;
+    edit_kids(bcindex, x, begin, end);
+    std::vector<uint32_t> &list = bcindex.children[x];
+    list.assign(begin, end);
+    return list;
+}
+
+/* returns the number of neighbours of vertex @x listed in the base network
+ * (removed or not) and points @more at those added since (or nullptr)
+ */
+static uint32_t edit_arcs_of(bc_forest &bcindex, uint32_t x,
+        const std::vector<uint32_t> *&more) {
+    std::unordered_map<uint32_t, std::vector<uint32_t> >::const_iterator it
+        = bcindex.edit_more.find(x);
+    more = it == bcindex.edit_more.end() ? nullptr : &it->second;
+    return x < bcindex.vertices
+        ? bcindex.edit_first[x+1] - bcindex.edit_first[x] : 0;
+}
+
+/* returns the number of neighbours vertex @x has left
+ */
+static uint32_t edit_degree(bc_forest &bcindex, uint32_t x) {
+    const std::vector<uint32_t> *more;
+    uint32_t base = edit_arcs_of(bcindex, x, more);
+    uint32_t count = more ? more->size() : 0;
+    for (uint32_t i = 0; i < base; ++i) {
+        count += !bcindex.removed.count(
+            bcindex.edit_arcs[bcindex.edit_first[x] + i]);
+    }
+    return count;
+}
+
+/* removes one @x from the list @list
+ */
+static void edit_erase(std::vector<uint32_t> &list, uint32_t x) {
+    std::vector<uint32_t>::iterator it = std::find(list.begin(), list.end(), x);
+    *it = list.back();
+    list.pop_back();
+}
+
+/* hangs node @x below @p (NOPARENT to make it a root), leaving its depth
+ */
+static void edit_hang(bc_forest &bcindex, uint32_t x, uint32_t p) {
+    std::vector<uint32_t> &parent = bcindex.parent.vec;
+    if (parent[x] != NOPARENT)
+        edit_erase(edit_children(bcindex, parent[x]), x);
+    parent[x] = p;
+    if (p != NOPARENT)
+        edit_children(bcindex, p).push_back(x);
+}
+
+/* drops the block @b from the forest, forgetting its children
+ */
+static void edit_drop(bc_forest &bcindex, uint32_t b) {
+    edit_hang(bcindex, b, NOPARENT);
+    bcindex.children[b].clear();
+}
+
+/* sets the comp of the subtree at @r to @c and its depths from @d at @r down
+ *
+ * returns the number of vertices in the subtree
+ */
+static uint32_t edit_relabel(bc_forest &bcindex, uint32_t r, uint32_t d,
+        uint32_t c) {
+    std::vector<uint32_t> &depth = bcindex.depth.vec, &comp = bcindex.comp.vec;
+    std::vector<uint32_t> stk(1, r);
+    depth[r] = d;
+    uint32_t count = 0;
+    while (!stk.empty()) {
+        uint32_t x = stk.back();
+        stk.pop_back();
+        comp[x] = c;
+        count += !bcindex.block[x];
+        const uint32_t *begin, *end;
+        edit_kids(bcindex, x, begin, end);
+        for (const uint32_t *y = begin; y != end; ++y) {
+            depth[*y] = depth[x] + 1;
+            stk.push_back(*y);
+        }
+    }
+    return count;
+}
+
+/* deepens the nodes below @r that are no deeper than their parents
+ */
+static void edit_deepen(bc_forest &bcindex, uint32_t r) {
+    std::vector<uint32_t> &depth = bcindex.depth.vec;
+    std::vector<uint32_t> stk(1, r);
+    while (!stk.empty()) {
+        uint32_t x = stk.back();
+        stk.pop_back();
+        const uint32_t *begin, *end;
+        edit_kids(bcindex, x, begin, end);
+        for (const uint32_t *y = begin; y != end; ++y) {
+            if (depth[*y] <= depth[x]) {
+                depth[*y] = depth[x] + 1;
+                stk.push_back(*y);
+            }
+        }
+    }
+}
+
+/* makes @r the root of its tree by reversing the path above it
+ */
+static void edit_reroot(bc_forest &bcindex, uint32_t r) {
+    std::vector<uint32_t> &parent = bcindex.parent.vec;
+    for (uint32_t x = r, below = NOPARENT; x != NOPARENT; ) {
+        uint32_t above = parent[x];
+        if (above != NOPARENT)
+            edit_erase(edit_children(bcindex, above), x);
+        parent[x] = below;
+        if (below != NOPARENT)
+            edit_children(bcindex, below).push_back(x);
+        below = x;
+        x = above;
+    }
+}
+
+/* adds the pair vertex @x between the vertices @a and @b of different trees
+ */
+static void edit_join(bc_forest &bcindex, uint32_t a, uint32_t b, uint32_t x) {
+    std::vector<uint32_t> &depth = bcindex.depth.vec, &comp = bcindex.comp.vec;
+    if (bcindex.edit_size[comp[a]] < bcindex.edit_size[comp[b]])
+        std::swap(a, b);
+    // the smaller tree hangs below the bridges a-x and x-b
+    uint32_t c = comp[a], old = comp[b];
+    edit_reroot(bcindex, b);
+    uint32_t ax = edit_node(bcindex, true), xb = edit_node(bcindex, true);
+    edit_hang(bcindex, ax, a);
+    edit_hang(bcindex, x, ax);
+    edit_hang(bcindex, xb, x);
+    edit_hang(bcindex, b, xb);
+    depth[ax] = depth[a] + 1;
+    comp[ax] = c;
+    edit_relabel(bcindex, x, depth[a] + 2, c);
+    bcindex.edit_size[c] += bcindex.edit_size[old] + 1;
+    bcindex.edit_size.erase(old);
+}
+
+/* adds the pair vertex @x between the vertices @a and @b of the same tree
+ */
+static void edit_merge(bc_forest &bcindex, uint32_t a, uint32_t b, uint32_t x) {
+    std::vector<uint32_t> &parent = bcindex.parent.vec;
+    std::vector<uint32_t> &depth = bcindex.depth.vec, &comp = bcindex.comp.vec;
+    // climb from both ends to the top of the path between them; raising the
+    // deeper end never passes the top, as depth grows from parent to child
+    std::vector<uint32_t> merged;
+    uint32_t pa = a, pb = b;
+    while (pa != pb) {
+        uint32_t &up = depth[pa] >= depth[pb] ? pa : pb;
+        up = parent[up];
+        if (bcindex.block[up])
+            merged.push_back(up);
+    }
+    std::sort(merged.begin(), merged.end());
+    merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+    uint32_t top = bcindex.block[pa] ? parent[pa] : pa, keep;
+    if (merged.empty()) {
+        // a row from a vertex to itself
+        keep = edit_node(bcindex, true);
+        depth[keep] = depth[a] + 1;
+        comp[keep] = comp[a];
+        edit_hang(bcindex, keep, a);
+    } else {
+        // the blocks on the path become one: the largest takes in the
+        // vertices of the others, and hangs where the highest one hung
+        keep = merged[0];
+        uint32_t high = depth[keep];
+        for (uint32_t m : merged) {
+            if (edit_children(bcindex, m).size()
+                    > edit_children(bcindex, keep).size())
+                keep = m;
+            high = std::min(high, depth[m]);
+        }
+        std::vector<uint32_t> verts;
+        for (uint32_t m : merged) {
+            if (parent[m] != top)
+                verts.push_back(parent[m]);
+            if (m != keep) {
+                const std::vector<uint32_t> &kids = edit_children(bcindex, m);
+                verts.insert(verts.end(), kids.begin(), kids.end());
+            }
+        }
+        for (uint32_t m : merged) {
+            if (m != keep)
+                edit_drop(bcindex, m);
+        }
+        // every vertex taken in already lies below the highest block
+        for (uint32_t y : verts) {
+            if (parent[y] != keep) {
+                parent[y] = keep;
+                edit_children(bcindex, keep).push_back(y);
+            }
+        }
+        edit_hang(bcindex, keep, top);
+        depth[keep] = high;
+    }
+    edit_hang(bcindex, x, keep);
+    depth[x] = depth[keep] + 1;
+    comp[x] = comp[a];
+    ++bcindex.edit_size[comp[a]];
+}
+
+/* recomputes the blocks of the vertices of the block @b, after a pair vertex
+ * has been taken out of it
+ */
+static void edit_rebuild(bc_forest &bcindex, uint32_t b) {
+    std::vector<uint32_t> &parent = bcindex.parent.vec;
+    std::vector<uint32_t> &depth = bcindex.depth.vec, &comp = bcindex.comp.vec;
+    std::vector<uint32_t> verts(1, parent[b]);
+    const std::vector<uint32_t> &kids = edit_children(bcindex, b);
+    verts.insert(verts.end(), kids.begin(), kids.end());
+    uint32_t n = verts.size();
+    if (n == 1) {
+        edit_drop(bcindex, b);
+        return;
+    }
+    for (uint32_t i = 0; i < n; ++i)
+        bcindex.edit_mark[verts[i]] = i;
+
+    // Tarjan's algorithm over the vertices of the block alone, from its top
+    // (they are connected, as the block was biconnected); block k gets the
+    // vertices members[first[k]..first[k+1]) below the vertex above[k]
+    uint32_t count = 0;
+    std::vector<uint32_t> disc(n, 0), low(n), next(n, 0), from(n);
+    std::vector<uint32_t> call(1, 0), acc(1, 0);
+    std::vector<uint32_t> members, first(1, 0), above;
+    disc[0] = low[0] = ++count;
+    from[0] = NOPARENT;
+    while (!call.empty()) {
+        uint32_t v = call.back(), x = verts[v], w = NOPARENT;
+        const std::vector<uint32_t> *more;
+        uint32_t base = edit_arcs_of(bcindex, x, more);
+        uint32_t arcs = base + (more ? more->size() : 0);
+        while (next[v] < arcs) {
+            uint32_t i = next[v]++;
+            uint32_t y = i < base ? bcindex.edit_arcs[bcindex.edit_first[x] + i]
+                : (*more)[i - base];
+            if (bcindex.edit_mark[y] == NOPARENT)
+                continue; // a neighbour in another block, or removed
+            w = bcindex.edit_mark[y];
+            if (!disc[w])
+                break;
+            if (w != from[v])
+                low[v] = std::min(low[v], disc[w]);
+            w = NOPARENT;
+        }
+        if (w != NOPARENT) {
+            // recurse on w
+            disc[w] = low[w] = ++count;
+            from[w] = v;
+            call.push_back(w);
+            acc.push_back(w);
+            continue;
+        }
+        call.pop_back();
+        if (call.empty())
+            break;
+        uint32_t p = call.back();
+        low[p] = std::min(low[p], low[v]);
+        if (low[v] >= disc[p]) {
+            uint32_t y;
+            do {
+                y = acc.back();
+                acc.pop_back();
+                members.push_back(verts[y]);
+            } while (y != v);
+            first.push_back(members.size());
+            above.push_back(verts[p]);
+        }
+    }
+    for (uint32_t y : verts)
+        bcindex.edit_mark[y] = NOPARENT;
+    if (above.size() == 1)
+        return; // still a single block
+
+    // hang the blocks in place of b; they are found after those below them,
+    // so go top-down in reverse
+    std::vector<uint32_t> old(n);
+    for (uint32_t i = 0; i < n; ++i)
+        old[i] = depth[verts[i]];
+    edit_drop(bcindex, b);
+    for (size_t k = above.size(); k-- > 0; ) {
+        uint32_t nb = edit_node(bcindex, true);
+        std::vector<uint32_t> &list = bcindex.children[nb];
+        list.assign(members.begin() + first[k], members.begin() + first[k+1]);
+        edit_children(bcindex, above[k]).push_back(nb);
+        parent[nb] = above[k];
+        depth[nb] = depth[above[k]] + 1;
+        comp[nb] = comp[above[k]];
+        for (uint32_t y : list) {
+            parent[y] = nb;
+            depth[y] = depth[nb] + 1;
+        }
+    }
+    for (uint32_t i = 1; i < n; ++i) {
+        if (depth[verts[i]] > old[i])
+            edit_deepen(bcindex, verts[i]);
+    }
+}
+
+/* returns the node of the vertex of the graph named @id (NOPARENT if there is
+ * none), adding it first if @add is set
+ */
+static uint32_t edit_vertex(network &net, const jkey &id, bool add) {
+    bc_forest &bcindex = net.index;
+    bool added;
+    uintf v = add ? net.idx.insert(id, added) : net.idx.find(id);
+    if (v == id_table::NONE)
+        return NOPARENT;
+    if (v+2 < bcindex.real)
+        return v+2;
+    std::unordered_map<uint32_t, uint32_t>::iterator it
+        = bcindex.vertexnode.find(v+2);
+    if (it != bcindex.vertexnode.end())
+        return it->second;
+    if (!add)
+        return NOPARENT;
+    uint32_t x = edit_node(bcindex, false);
+    bcindex.vertexnode[v+2] = x;
+    bcindex.nodevertex[x] = v+2;
+    bcindex.edit_size[x] = 1;
+    return x;
+}
+
+void index_add_row(network &net, const jkey &via, const jkey &from,
+        const jkey &to) {
+    bc_forest &bcindex = net.index;
+    edit_begin(net);
+    bool added;
+    uint32_t e = net.edgeidx.insert(via, added);
+    uint32_t a = edit_vertex(net, from, true), b = edit_vertex(net, to, true);
+    uint32_t x = edit_node(bcindex, false);
+    bcindex.pairedge[x] = e;
+    bcindex.edgepairs[e].push_back(x);
+    bcindex.removed.erase(a);
+    bcindex.removed.erase(b);
+    bcindex.edit_more[a].push_back(x);
+    bcindex.edit_more[b].push_back(x);
+    bcindex.edit_more[x] = { a, b };
+    if (bcindex.comp.vec[a] != bcindex.comp.vec[b])
+        edit_join(bcindex, a, b, x);
+    else
+        edit_merge(bcindex, a, b, x);
+    edit_end(bcindex);
+}
+
+bool index_remove_row(network &net, const jkey &via, const jkey &from,
+        const jkey &to) {
+    bc_forest &bcindex = net.index;
+    edit_begin(net);
+    uint32_t a = edit_vertex(net, from, false), b = edit_vertex(net, to, false);
+    std::vector<uint32_t> pairs;
+    index_terminals(net, via, pairs);
+    // a row the same way round if there is one, else one the other way
+    uint32_t x = NOPARENT, swapped = NOPARENT, e = 0;
+    for (uint32_t y : pairs) {
+        std::pair<uint32_t, uint32_t> ends = y < bcindex.vertices
+            ? net.edgenodes[y - bcindex.real]
+            : std::make_pair(bcindex.edit_more[y][0], bcindex.edit_more[y][1]);
+        if (ends.first == a && ends.second == b)
+            x = y;
+        else if (ends.first == b && ends.second == a)
+            swapped = y;
+    }
+    if (x == NOPARENT)
+        x = swapped;
+    if (a == NOPARENT || b == NOPARENT || x == NOPARENT)
+        return false;
+
+    if (x < bcindex.vertices) {
+        bcindex.removed.insert(x);
+    } else {
+        e = bcindex.pairedge[x];
+        edit_erase(bcindex.edit_more[a], x);
+        edit_erase(bcindex.edit_more[b], x);
+        bcindex.edit_more.erase(x);
+        edit_erase(bcindex.edgepairs[e], x);
+        bcindex.pairedge.erase(x);
+    }
+    if (!edit_degree(bcindex, a))
+        bcindex.removed.insert(a);
+    if (!edit_degree(bcindex, b))
+        bcindex.removed.insert(b);
+    // trees are rooted at vertices of the graph, so x hangs below a block
+    std::vector<uint32_t> &parent = bcindex.parent.vec;
+    uint32_t c = bcindex.comp.vec[x], above = parent[x];
+    --bcindex.edit_size[c];
+    edit_hang(bcindex, x, NOPARENT);
+    bcindex.comp.vec[x] = x;
+    if (edit_children(bcindex, x).empty()) {
+        // x lies in that block alone, which may come apart without it
+        edit_rebuild(bcindex, above);
+    } else {
+        // x cuts its tree, so both its blocks are bridges: the part below
+        // becomes a tree of its own
+        uint32_t below = edit_children(bcindex, x)[0];
+        uint32_t r = edit_children(bcindex, below)[0];
+        edit_hang(bcindex, r, NOPARENT);
+        edit_drop(bcindex, below);
+        edit_drop(bcindex, above);
+        uint32_t moved = edit_relabel(bcindex, r, bcindex.depth.vec[r], r);
+        bcindex.edit_size[c] -= moved;
+        bcindex.edit_size[r] = moved;
+    }
+    bcindex.children.erase(x);
+    edit_end(bcindex);
+    return true;
+}
+
+bool read_edits(network &net, const char *filename,
+        std::vector<std::string> &controllers) {
+    std::ifstream fin(filename);
+    if (!fin) {
+        fprintf(stderr, "cannot read %s\n", filename);
+        return false;
+    }
+    size_t lineno = 0;
+    for (std::string line; std::getline(fin, line); ) {
+        ++lineno;
+        std::istringstream fields(line);
+        std::string op, id[3];
+        if (!(fields >> op))
+            continue; // blank line
+        int want = op == "add-row" || op == "remove-row" ? 3
+            : op == "add-controller" || op == "remove-controller" ? 1 : 0;
+        int got = 0;
+        while (got < 3 && fields >> id[got])
+            ++got;
+        bool ok = want && got == want;
+        if (ok && op == "add-row") {
+            index_add_row(net, jkey(id[0]), jkey(id[1]), jkey(id[2]));
+        } else if (ok && op == "remove-row") {
+            ok = index_remove_row(net, jkey(id[0]), jkey(id[1]), jkey(id[2]));
+        } else if (ok && op == "add-controller") {
+            controllers.push_back(id[0]);
+        } else if (ok) {
+            size_t before = controllers.size();
+            controllers.erase(std::remove(controllers.begin(),
+                controllers.end(), id[0]), controllers.end());
+            ok = controllers.size() < before;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s:%zu: cannot apply edit: %s\n", filename,
+                lineno, line.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,445 @@
+/* BLOCK-CUT TREE INDEX
+ * author: Zach Goldthorpe
+ *
+ * The file provides an index answering upstream queries for arbitrary sets of
+ * starting points and controllers without traversing the whole network.
+ *
+ * The index is the block-cut forest of the rows alone, with every <u, v> pair
+ * of every edge subdivided by a vertex of its own. Subdividing does not change
+ * the blocks, but it makes reduction 1 free: a starting point or controller on
+ * an edge is simply the set of vertices subdividing its pairs.
+ *
+ * The forest has a node for every vertex and every block, a block being joined
+ * to each of its vertices; each tree is rooted at a vertex, so the parent of a
+ * block is one of its vertices and its children are the others. Within one
+ * tree, the union of the simple paths from the starting points to the
+ * controllers is exactly the union of the nodes of the smallest subtree
+ * spanning all of them (provided the tree holds at least one of each), and the
+ * upstream features are the vertices of that subtree together with the
+ * vertices of its blocks. Matching traverse(), which marks every block of TAIL
+ * once it reaches TAIL at all, a tree holding controllers but no starting
+ * points contributes the subtree spanning its controllers in the same way.
+ * The subtree is found by repeatedly raising the deepest node to its parent
+ * until a single node remains, so that a query costs time in proportion to
+ * the size of its answer.
+ *
+ * Taking the starting points one at a time, the subtrees spanning the
+ * controllers of each tree are the same for all of them: a starting point
+ * reaching a controller only adds the path joining it to the subtree of its
+ * tree. index_attribute finds the subtrees once and then walks each path, so
+ * attributing the features to every starting point costs time in proportion
+ * to the index and the answers, rather than one query per starting point.
+ *
+ * The index is the bc_forest of the network [see network.h], and is built
+ * before any query runs on it; the queries then only read it.
+ *
+ * The index can also be edited in place as rows are added to or removed from
+ * the network [see bc_edit.h].
+ *
+ * build_index:       build the index of the base network
+ * index_terminals:   translate an ID into the vertices of the index
+ * index_controllers: list the controllers of the base network
+ * index_upstream:    find the upstream vertices of the index for a query
+ * index_attribute:   find them for each starting point of a query on its own
+ * index_edge:        find the edge a vertex of the index was made from
+ * index_feature:     find the feature a vertex of the index stands for
+ */
+
+#ifndef _bc_index_h_
+#define _bc_index_h_
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include "flat.h"
+#include "network.h"
+#include "read_graph.h"
+
+// the parent of the roots of the forest
+#define NOPARENT UINT32_MAX
+// the edge of a vertex of the index that is a vertex of the graph
+#define NOEDGE UINT32_MAX
+
+/* builds the index of @net from the rows of its base network, which must have
+ * been read or loaded already
+ */
+void build_index(network &net);
+
+/* appends to @out the vertices of the index of @net making up the feature
+ * named @id, as reduction 1 would: the vertex itself, or one vertex per
+ * <u, v> pair of the edge
+ */
+void index_terminals(const network &net, const jkey &id,
+        std::vector<uint32_t> &out);
+
+/* appends to @out the ID's of the controllers of the base network @net, each
+ * once, as the JSON lists them: those the rows do not name are kept too, so
+ * that an edit adding them [see bc_edit.h] makes them controllers
+ */
+void index_controllers(const network &net, std::vector<std::string> &out);
+
+/* fills @up with the vertices of the index of @net upstream of the starting
+ * points @starts for the controllers @ctrls (as traverse() would mark them),
+ * sorted and without repetition
+ */
+void index_upstream(const network &net, const std::vector<uint32_t> &starts,
+        const std::vector<uint32_t> &ctrls, std::vector<uint32_t> &up);
+
+/* fills @shared with the vertices of the index of @net upstream of every
+ * starting point reaching one of the controllers @ctrls (those of the subtrees
+ * spanning the controllers), sorted and without repetition, then calls the
+ * function-type @action with the index i of each starting point of @starts
+ * (which lists the vertices of the index making up each), whether it reaches
+ * a controller, and the vertices joining it to @shared. Together these are
+ * the vertices index_upstream finds for starting point i alone.
+ */
+template<typename FUNC>
+void index_attribute(const network &net,
+        const std::vector<std::vector<uint32_t> > &starts,
+        const std::vector<uint32_t> &ctrls, std::vector<uint32_t> &shared,
+        const FUNC &action);
+
+/* returns the edge whose <u, v> pair the vertex @x of the index of @net
+ * subdivides, or NOEDGE if @x is a vertex of the graph; the pairs of an edge in
+ * the base network are subdivided by consecutive vertices
+ */
+uint32_t index_edge(const network &net, uint32_t x);
+
+/* returns the feature [see read_graph.h] the vertex @x of the index of @net
+ * stands for (NOFEATURE for HEAD and TAIL)
+ */
+uint32_t index_feature(const network &net, uint32_t x);
+
+
+// ==== DEFINITIONS ==== //
+
+/* returns whether the node @x of the index @bcindex is a block
+ */
+static inline bool index_block(const bc_forest &bcindex, uint32_t x) {
+    return bcindex.block.empty() ? x >= bcindex.vertices : bcindex.block[x];
+}
+
+/* points [@begin, @end) at the children of the block @x of the index @bcindex
+ */
+static inline void index_children(const bc_forest &bcindex, uint32_t x,
+        const uint32_t *&begin, const uint32_t *&end) {
+    if (!bcindex.children.empty()) {
+        auto it = bcindex.children.find(x);
+        if (it != bcindex.children.end()) {
+            begin = it->second.data();
+            end = begin + it->second.size();
+            return;
+        }
+    }
+    uint32_t b = x - bcindex.vertices;
+    begin = bcindex.blockvtx.data() + bcindex.blockfirst[b];
+    end = bcindex.blockvtx.data() + bcindex.blockfirst[b+1];
+}
+
+void build_index(network &net) {
+    bc_forest &bcindex = net.index;
+    const flat<std::pair<uint32_t, uint32_t> > &edgenodes = net.edgenodes;
+    uint32_t real = 2 + net.idx.size(), pairs = edgenodes.size();
+    uint32_t n = real + pairs;
+
+    // the subdivided network: vertex real+p sits in the middle of pair p
+    std::vector<uint32_t> first(n+1, 0), adj(4*(size_t)pairs);
+    for (uint32_t p = 0; p < pairs; ++p) {
+        ++first[edgenodes[p].first+1];
+        ++first[edgenodes[p].second+1];
+        first[real+p+1] += 2;
+    }
+    for (uint32_t v = 0; v < n; ++v)
+        first[v+1] += first[v];
+    std::vector<uint32_t> fill(first.begin(), first.end()-1);
+    for (uint32_t p = 0; p < pairs; ++p) {
+        uint32_t u = edgenodes[p].first, v = edgenodes[p].second;
+        adj[fill[u]++] = real+p;
+        adj[fill[v]++] = real+p;
+        adj[fill[real+p]++] = u;
+        adj[fill[real+p]++] = v;
+    }
+
+    // Tarjan's algorithm, making a block node whenever a block is complete;
+    // every vertex is then hung below the block that completes it
+    bcindex.real = real;
+    bcindex.vertices = n;
+    std::vector<uint32_t> &parent = bcindex.parent.vec;
+    std::vector<uint32_t> &blockfirst = bcindex.blockfirst.vec;
+    std::vector<uint32_t> &blockvtx = bcindex.blockvtx.vec;
+    parent.assign(n, NOPARENT);
+    blockfirst.assign(1, 0);
+    blockvtx.clear();
+    // nodes in the order they are hung, which is bottom-up
+    std::vector<uint32_t> order, disc(n, 0), low(n), next(n), from(n);
+    std::vector<uint32_t> call, acc;
+    order.reserve(2*(size_t)n);
+    uint32_t count = 0;
+    for (uint32_t r = 0; r < n; ++r) {
+        if (disc[r])
+            continue;
+        disc[r] = low[r] = ++count;
+        next[r] = first[r];
+        from[r] = NOPARENT;
+        call.push_back(r);
+        acc.push_back(r);
+        while (!call.empty()) {
+            uint32_t v = call.back();
+            if (next[v] < first[v+1]) {
+                uint32_t w = adj[next[v]++];
+                if (!disc[w]) {
+                    // recurse on w
+                    disc[w] = low[w] = ++count;
+                    next[w] = first[w];
+                    from[w] = v;
+                    call.push_back(w);
+                    acc.push_back(w);
+                } else if (w != from[v]) {
+                    low[v] = std::min(low[v], disc[w]);
+                }
+                continue;
+            }
+            call.pop_back();
+            if (call.empty())
+                break;
+            uint32_t p = call.back();
+            low[p] = std::min(low[p], low[v]);
+            if (low[v] >= disc[p]) {
+                // p separates the block of v from the rest
+                uint32_t b = parent.size();
+                uint32_t y;
+                do {
+                    y = acc.back();
+                    acc.pop_back();
+                    parent[y] = b;
+                    blockvtx.push_back(y);
+                    order.push_back(y);
+                } while (y != v);
+                parent.push_back(p);
+                blockfirst.push_back(blockvtx.size());
+                order.push_back(b);
+            }
+        }
+        acc.pop_back(); // the root
+        order.push_back(r);
+    }
+
+    // parents are hung after their children, so go top-down in reverse
+    std::vector<uint32_t> &depth = bcindex.depth.vec, &comp = bcindex.comp.vec;
+    depth.assign(parent.size(), 0);
+    comp.assign(parent.size(), 0);
+    for (size_t i = order.size(); i-- > 0; ) {
+        uint32_t x = order[i];
+        if (parent[x] == NOPARENT) {
+            comp[x] = x;
+        } else {
+            depth[x] = depth[parent[x]] + 1;
+            comp[x] = comp[parent[x]];
+        }
+    }
+    bcindex.parent.sync();
+    bcindex.depth.sync();
+    bcindex.comp.sync();
+    bcindex.blockfirst.sync();
+    bcindex.blockvtx.sync();
+}
+
+void index_terminals(const network &net, const jkey &id,
+        std::vector<uint32_t> &out) {
+    const bc_forest &bcindex = net.index;
+    const flat<uint32_t> &edgefirst = net.edgefirst;
+    uintf v, e;
+    if ((v = net.idx.find(id)) != id_table::NONE) {
+        auto it = bcindex.vertexnode.find(v+2);
+        uint32_t x = v+2 < bcindex.real ? v+2
+            : it != bcindex.vertexnode.end() ? it->second : NOPARENT;
+        if (x != NOPARENT && (bcindex.removed.empty()
+                || !bcindex.removed.count(x)))
+            out.push_back(x);
+    }
+    if ((e = net.edgeidx.find(id)) != id_table::NONE) {
+        if (e+1 < edgefirst.size()) {
+            for (uint32_t p = edgefirst[e]; p < edgefirst[e+1]; ++p) {
+                if (bcindex.removed.empty()
+                        || !bcindex.removed.count(bcindex.real + p))
+                    out.push_back(bcindex.real + p);
+            }
+        }
+        auto it = bcindex.edgepairs.find(e);
+        if (it != bcindex.edgepairs.end())
+            out.insert(out.end(), it->second.begin(), it->second.end());
+    }
+}
+
+void index_controllers(const network &net, std::vector<std::string> &out) {
+    const flat<char> &names = net.ctrlnames;
+    const flat<uint64_t> &first = net.ctrlfirst;
+    std::unordered_set<std::string> seen;
+    for (size_t i = 0; i+1 < first.size(); ++i) {
+        std::string id(names.data() + first[i], first[i+1] - first[i]);
+        if (seen.insert(id).second)
+            out.push_back(id);
+    }
+}
+
+void index_upstream(const network &net, const std::vector<uint32_t> &starts,
+        const std::vector<uint32_t> &ctrls, std::vector<uint32_t> &up) {
+    const bc_forest &bcindex = net.index;
+    up.clear();
+    // the starting points only count in the trees holding a controller
+    std::unordered_set<uint32_t> ccomp;
+    for (uint32_t x : ctrls)
+        ccomp.insert(bcindex.comp[x]);
+    std::unordered_map<uint32_t, std::vector<uint32_t> > terms;
+    for (uint32_t x : starts) {
+        if (ccomp.count(bcindex.comp[x]))
+            terms[bcindex.comp[x]].push_back(x);
+    }
+    if (terms.empty())
+        return; // no starting point reaches a controller
+    // as in traverse(), the controllers of the other trees then count as well:
+    // every block they share with TAIL is marked once TAIL is reached
+    for (uint32_t x : ctrls)
+        terms[bcindex.comp[x]].push_back(x);
+
+    for (const std::pair<const uint32_t, std::vector<uint32_t> > &t : terms) {
+        // raise the deepest node until only the top of the subtree remains
+        std::priority_queue<std::pair<uint32_t, uint32_t> > deepest;
+        std::unordered_set<uint32_t> seen;
+        for (uint32_t x : t.second) {
+            if (seen.insert(x).second)
+                deepest.emplace(bcindex.depth[x], x);
+        }
+        while (!deepest.empty()) {
+            uint32_t x = deepest.top().second;
+            deepest.pop();
+            if (!index_block(bcindex, x)) {
+                up.push_back(x);
+            } else {
+                // every vertex of a block in the subtree is upstream
+                const uint32_t *begin, *end;
+                index_children(bcindex, x, begin, end);
+                up.push_back(bcindex.parent[x]);
+                up.insert(up.end(), begin, end);
+            }
+            if (deepest.empty())
+                break; // x is the top of the subtree
+            uint32_t p = bcindex.parent[x];
+            if (seen.insert(p).second)
+                deepest.emplace(bcindex.depth[p], p);
+        }
+    }
+    std::sort(up.begin(), up.end());
+    up.erase(std::unique(up.begin(), up.end()), up.end());
+}
+
+/* appends to @out the vertices of the index @bcindex that the node @x of a
+ * subtree spanning a query makes upstream: @x itself, or every vertex of the
+ * block @x
+ */
+static inline void index_node_vertices(const bc_forest &bcindex, uint32_t x,
+        std::vector<uint32_t> &out) {
+    if (!index_block(bcindex, x)) {
+        out.push_back(x);
+        return;
+    }
+    const uint32_t *begin, *end;
+    index_children(bcindex, x, begin, end);
+    out.push_back(bcindex.parent[x]);
+    out.insert(out.end(), begin, end);
+}
+
+template<typename FUNC>
+void index_attribute(const network &net,
+        const std::vector<std::vector<uint32_t> > &starts,
+        const std::vector<uint32_t> &ctrls, std::vector<uint32_t> &shared,
+        const FUNC &action) {
+    const bc_forest &bcindex = net.index;
+    shared.clear();
+    std::unordered_map<uint32_t, std::vector<uint32_t> > terms;
+    for (uint32_t x : ctrls)
+        terms[bcindex.comp[x]].push_back(x);
+    // the nodes of the subtrees spanning the controllers, and the top of the
+    // subtree of each tree
+    std::unordered_set<uint32_t> spanned;
+    std::unordered_map<uint32_t, uint32_t> top;
+    for (const std::pair<const uint32_t, std::vector<uint32_t> > &t : terms) {
+        // as in index_upstream, without the starting points
+        std::priority_queue<std::pair<uint32_t, uint32_t> > deepest;
+        for (uint32_t x : t.second) {
+            if (spanned.insert(x).second)
+                deepest.emplace(bcindex.depth[x], x);
+        }
+        while (!deepest.empty()) {
+            uint32_t x = deepest.top().second;
+            deepest.pop();
+            index_node_vertices(bcindex, x, shared);
+            if (deepest.empty()) {
+                top[t.first] = x;
+                break;
+            }
+            uint32_t p = bcindex.parent[x];
+            if (spanned.insert(p).second)
+                deepest.emplace(bcindex.depth[p], p);
+        }
+    }
+    std::sort(shared.begin(), shared.end());
+    shared.erase(std::unique(shared.begin(), shared.end()), shared.end());
+
+    std::vector<uint32_t> path;
+    for (size_t i = 0; i < starts.size(); ++i) {
+        path.clear();
+        bool reaches = false;
+        for (uint32_t x : starts[i]) {
+            auto it = top.find(bcindex.comp[x]);
+            if (it == top.end())
+                continue; // no controller in this tree
+            reaches = true;
+            // climb from x and from the top of the subtree, the deeper first,
+            // until x enters the subtree or the two meet above it
+            uint32_t y = it->second;
+            while (!spanned.count(x)) {
+                if (x == y) {
+                    index_node_vertices(bcindex, x, path);
+                    break;
+                }
+                if (bcindex.depth[x] >= bcindex.depth[y]) {
+                    index_node_vertices(bcindex, x, path);
+                    x = bcindex.parent[x];
+                } else {
+                    index_node_vertices(bcindex, y, path);
+                    y = bcindex.parent[y];
+                }
+            }
+        }
+        action(i, reaches, path);
+    }
+}
+
+uint32_t index_edge(const network &net, uint32_t x) {
+    const bc_forest &bcindex = net.index;
+    const flat<uint32_t> &edgefirst = net.edgefirst;
+    if (x < bcindex.real)
+        return NOEDGE;
+    if (x < bcindex.vertices) {
+        const uint32_t *e = std::upper_bound(edgefirst.data(),
+            edgefirst.data() + edgefirst.size(), x - bcindex.real);
+        return e - edgefirst.data() - 1;
+    }
+    auto it = bcindex.pairedge.find(x);
+    return it == bcindex.pairedge.end() ? NOEDGE : it->second;
+}
+
+uint32_t index_feature(const network &net, uint32_t x) {
+    uint32_t e = index_edge(net, x);
+    if (e != NOEDGE)
+        return edge_feature(net, e);
+    if (x >= net.index.real)
+        x = net.index.nodevertex.at(x);
+    return x < 2 ? NOFEATURE : x-2;
+}
+
+#endif
@@ -0,0 +1,194 @@
+/* Biconnectivity Scaling Benchmark
+ * author: Zach Goldthorpe
+ *
+ * Times the serial traverse() against par_traverse() on 1, 2, 4, 8 and 16
+ * threads, for one query on either a synthetic network or a given one. Every
+ * parallel run must mark the same upstream vertices as the serial one. The
+ * serial traverse() is then timed again after reordering the junctions in
+ * bfs, rcm and dfs order [see reorder.h], applied in turn to the same network,
+ * which must mark the same upstream junctions (by name).
+ *
+ * The synthetic network is a side x side grid of rows (one large biconnected
+ * component) with a path of side*side rows hanging off one corner, each path
+ * vertex carrying a short spur, so that both the cycles and the bridges of
+ * the algorithm get exercised. The controller is the far corner of the grid,
+ * and the starting point the end of the path.
+ *
+ * usage: bcc_bench [side] [repetitions]
+ *        bcc_bench <data.json> <startingpoints.txt> [repetitions]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <unistd.h>
+#include "read_graph.h"
+#include "traverse.h"
+#include "reorder.h"
+
+using namespace std;
+
+/* writes the synthetic network described above to @out
+ */
+static void synthesise(FILE *out, uintf side) {
+    uintf row = 0;
+    bool first = true;
+    auto link = [&](const string &u, const string &v) {
+        fprintf(out, "%s{\"viaGlobalId\": \"e%u\", \"fromGlobalId\": \"%s\", "
+            "\"toGlobalId\": \"%s\"}", first ? "" : ",\n", (unsigned)row++,
+            u.c_str(), v.c_str());
+        first = false;
+    };
+    auto grid = [](uintf i, uintf j) {
+        return "g" + to_string(i) + "_" + to_string(j);
+    };
+    fprintf(out, "{\"rows\": [\n");
+    for (uintf i = 0; i < side; ++i) {
+        for (uintf j = 0; j < side; ++j) {
+            if (i + 1 < side)
+                link(grid(i, j), grid(i+1, j));
+            if (j + 1 < side)
+                link(grid(i, j), grid(i, j+1));
+        }
+    }
+    string prev = grid(0, 0);
+    for (uintf k = 0; k < side * side; ++k) {
+        string p = "p" + to_string(k);
+        link(prev, p);
+        link(p, "s" + to_string(k));
+        prev = p;
+    }
+    fprintf(out, "\n], \"controllers\": [{\"globalId\": \"%s\"}]}\n",
+        grid(side-1, side-1).c_str());
+}
+
+/* the upstream vertices the output sweep reaches from HEAD, which is what the
+ * two engines must agree on (traverse() may leave marks off the sweep)
+ */
+static vector<bool> swept(const query &q) {
+    vector<bool> seen(q.ov.nodes, false);
+    vector<uintf> stk(1, HEAD);
+    seen[HEAD] = true;
+    while (!stk.empty()) {
+        uintf v = stk.back();
+        stk.pop_back();
+        const arc *begin, *end;
+        neighbours(q.ov, v, begin, end);
+        for (const arc *a = begin; a != end; ++a) {
+            if (q.upstream[a->to] && !seen[a->to]) {
+                seen[a->to] = true;
+                stk.push_back(a->to);
+            }
+        }
+    }
+    return seen;
+}
+
+/* the names of the vertices swept() reaches, which do not change when the
+ * junctions are renumbered (unlike the vertices and their features)
+ */
+static vector<string> swept_names(const query &q) {
+    vector<bool> seen = swept(q);
+    vector<string> names;
+    char buf[GUID_TEXT];
+    for (uintf v = 0; v < seen.size(); ++v) {
+        jstr name = seen[v] ? vertex_name(q.ov, v, buf) : jstr();
+        if (name.n)
+            names.push_back(string(name.s, name.n));
+    }
+    sort(names.begin(), names.end());
+    names.erase(unique(names.begin(), names.end()), names.end());
+    return names;
+}
+
+int main(int argc, char **argv) {
+    vector<string> ids;
+    int reps = 3;
+    string json;
+    if (argc >= 3 && !isdigit((unsigned char)argv[1][0])) {
+        json = argv[1];
+        ifstream in(argv[2]);
+        for (string line; getline(in, line); ) {
+            if (!line.empty())
+                ids.push_back(line);
+        }
+        if (argc > 3)
+            reps = atoi(argv[3]);
+    } else {
+        uintf side = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000;
+        if (argc > 2)
+            reps = atoi(argv[2]);
+        char path[] = "/tmp/bcc_benchXXXXXX";
+        int fd = mkstemp(path);
+        FILE *out = fd < 0 ? nullptr : fdopen(fd, "w");
+        if (!out) {
+            fprintf(stderr, "cannot write the synthetic network\n");
+            return 1;
+        }
+        synthesise(out, side);
+        fclose(out);
+        json = path;
+        ids.push_back("p" + to_string(side * side - 1));
+    }
+    network net;
+    bool ok = read_graph(net, json.c_str());
+    if (argc < 3 || isdigit((unsigned char)argv[1][0]))
+        unlink(json.c_str());
+    if (!ok) {
+        fprintf(stderr, "cannot read %s\n", json.c_str());
+        return 1;
+    }
+    query q;
+    q.ov.net = &net;
+    set_startingpoints(q.ov, ids);
+    printf("%u vertices, %zu arcs, %d repetitions\n", (unsigned)q.ov.nodes,
+        (size_t)net.graph.arcs.size(), reps);
+
+    // the best of reps runs of one engine, in seconds
+    auto time = [&](uintf threads) {
+        double best = 1e30;
+        for (int r = 0; r < reps; ++r) {
+            q.threads = threads;
+            q.upstream.assign(q.ov.nodes, false);
+            q.dfs.assign(q.ov.nodes, make_pair(0, 0));
+            chrono::steady_clock::time_point start
+                = chrono::steady_clock::now();
+            if (threads)
+                par_traverse(q);
+            else
+                traverse(q);
+            chrono::duration<double> elapsed
+                = chrono::steady_clock::now() - start;
+            best = min(best, elapsed.count());
+        }
+        return best;
+    };
+    double serial = time(0);
+    vector<bool> expect = swept(q);
+    printf("%-10s %9.3f s\n", "serial", serial);
+    bool agree = true;
+    for (uintf threads : { 1, 2, 4, 8, 16 }) {
+        double t = time(threads);
+        bool same = swept(q) == expect;
+        agree &= same;
+        printf("%2u threads %9.3f s  %5.2fx%s\n", (unsigned)threads, t,
+            serial / t, same ? "" : "  MISMATCH");
+    }
+    vector<string> upstream = swept_names(q);
+    const char *names[] = { "bfs", "rcm", "dfs" };
+    for (int k = 0; k < 3; ++k) {
+        reorder_network(net, (reorder_kind)(REORDER_BFS + k));
+        set_startingpoints(q.ov, ids);
+        double t = time(0);
+        bool same = swept_names(q) == upstream;
+        agree &= same;
+        printf("serial %s %9.3f s  %5.2fx%s\n", names[k], t, serial / t,
+            same ? "" : "  MISMATCH");
+    }
+    return agree ? 0 : 1;
+}
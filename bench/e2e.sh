@@ -0,0 +1,74 @@
+#!/bin/sh
+# End-to-end benchmark
+# author: Zach Goldthorpe
+#
+# Generates synthetic networks with gen_network [see bench/gen_network.cpp] and
+# times a whole run of the program on each: reading the network, traverse() and
+# writing the features, as reported by -v. Every topology is run with junction
+# and edge controllers, once through the fast reader (keys in order) and once
+# through the robust one (keys shuffled, controllers first).
+#
+# The networks are cached in bench/data, and every run appends a line to
+# bench/results.tsv, tagged with the commit it was built from, so that runs
+# across commits can be compared. The throughput columns are over the whole
+# run, not only the read.
+#
+# SIZES sets the numbers of rows (up to 10^8, given the disk for the JSON),
+# TOPOLOGIES the topologies and JOBS the -j of the runs.
+#
+# usage: [SIZES="10000 100000"] [TOPOLOGIES="mesh"] [JOBS=1] sh bench/e2e.sh
+
+SIZES=${SIZES:-"10000 100000 1000000"}
+TOPOLOGIES=${TOPOLOGIES:-"radial mesh chain hub"}
+JOBS=${JOBS:-1}
+
+dir=$(dirname "$0")
+data=$dir/data
+results=$dir/results.tsv
+mkdir -p "$data" || exit 1
+
+commit=$(git -C "$dir" rev-parse --short HEAD 2>/dev/null || echo unknown)
+git -C "$dir" diff --quiet HEAD -- 2>/dev/null || commit="$commit+"
+date=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+
+[ -f "$results" ] || printf 'commit\tdate\tdataset\treader\trows\tread_s\ttraverse_s\twrite_s\trows_per_s\tmb_per_s\tpeak_mb\n' > "$results"
+
+for rows in $SIZES; do
+    for topo in $TOPOLOGIES; do
+        for ctrl in vertex edge; do
+            for reader in fast robust; do
+                if [ $reader = fast ]; then order=ordered; else order=shuffled; fi
+                name=$topo-$ctrl-$order-$rows
+                json=$data/$name.json
+                sp=$data/$name.txt
+                if [ ! -f "$json" ] || [ ! -f "$sp" ]; then
+                    "$dir/gen_network" $topo $rows "$json.tmp" "$sp" $ctrl $order \
+                        && mv "$json.tmp" "$json" || exit 1
+                fi
+                if ! "$dir/giscup-$reader" -j "$JOBS" -v "$json" "$sp" \
+                        "$data/answer.txt" 2> "$data/log.txt"; then
+                    echo "giscup-$reader failed on $name:" >&2
+                    cat "$data/log.txt" >&2
+                    exit 1
+                fi
+                bytes=$(wc -c < "$json")
+                line=$(awk -v commit="$commit" -v date="$date" -v name="$name" \
+                        -v reader=$reader -v rows=$rows -v bytes="$bytes" '
+                    /^read:/ { r = $2 }
+                    /^traverse:/ { t = $2 }
+                    /^write:/ { w = $2 }
+                    /^peak memory:/ { m = $3 }
+                    END {
+                        s = r + t + w
+                        if (s <= 0) s = 1e-6
+                        printf "%s\t%s\t%s\t%s\t%d\t%.3f\t%.3f\t%.3f\t%.0f\t%.1f\t%.1f\n",
+                            commit, date, name, reader, rows, r, t, w,
+                            rows / s, bytes / 1e6 / s, m
+                    }' "$data/log.txt")
+                echo "$line" >> "$results"
+                echo "$line"
+            done
+        done
+    done
+done
+rm -f "$data/answer.txt" "$data/log.txt"
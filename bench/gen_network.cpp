@@ -0,0 +1,267 @@
+/* Synthetic Utility Network Generator
+ * author: Zach Goldthorpe
+ *
+ * Writes a network in the GIS Cup format (a "rows" list of <via, from, to>
+ * rows and a "controllers" list) along with a starting points file, for the
+ * end-to-end benchmarks [see bench/e2e.sh]. Every row is a pure function of its
+ * index and the seed, so the generator streams any number of rows in constant
+ * memory and the same arguments always produce the same files.
+ *
+ * The topologies are:
+ *  radial: feeders branching off one another, a tree (every edge a bridge);
+ *  mesh:   a grid wrapped into a cylinder, one large biconnected component;
+ *  chain:  a long line with a short loop every ten rows, so many small blocks
+ *          strung along one path;
+ *  hub:    a few junctions of very high degree, each vertex hanging off a hub
+ *          and, often, off the vertex before it.
+ * One row in twenty continues the edge of the row before it, so that edges with
+ * several <from, to> pairs occur throughout.
+ *
+ * The controllers are either junctions or edges. The rows list its keys in the
+ * order the fast reader expects, unless the shuffled order is asked for, in
+ * which case the keys of every row come in a random order and the controllers
+ * come before the rows (readable by the robust reader only). The scattered
+ * order keeps the keys in order but writes the rows themselves in a scrambled
+ * order, as an export sorted by some unrelated attribute would, so that the
+ * readers first meet the junctions in no order related to the network (this is
+ * what the vertex reordering [see reorder.h] is for).
+ *
+ * usage: gen_network <radial|mesh|chain|hub> <rows> <out.json> <out.txt>
+ *            [vertex|edge] [ordered|shuffled|scattered] [seed]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+enum topology { RADIAL, MESH, CHAIN, HUB };
+
+static uint64_t seed = 1;
+
+/* a well-mixed hash of @x under the seed, used as the randomness of a row
+ */
+static inline uint64_t mix(uint64_t x) {
+    x += seed * 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/* a network of @rows rows shaped as @topo
+ */
+struct network {
+    topology topo;
+    uint64_t rows, width, hubs;
+
+    network(topology topo, uint64_t rows) : topo(topo), rows(rows) {
+        width = max<uint64_t>(2, (uint64_t)sqrt_floor(rows / 2));
+        hubs = max<uint64_t>(1, rows / 20000);
+    }
+
+    static uint64_t sqrt_floor(uint64_t n) {
+        uint64_t r = 0;
+        while ((r+1) * (r+1) <= n)
+            ++r;
+        return r;
+    }
+
+    /* the number of junctions of the network; every topology numbers them in
+     * the order the rows first reach them
+     */
+    uint64_t vertices() const {
+        uint64_t most = 0, from, to;
+        for (uint64_t k = rows > 20 ? rows - 20 : 0; k < rows; ++k) {
+            row(k, from, to);
+            most = max(most, max(from, to));
+        }
+        return most + 1;
+    }
+
+    /* the junctions joined by row @k
+     */
+    void row(uint64_t k, uint64_t &from, uint64_t &to) const {
+        uint64_t h = mix(k);
+        switch (topo) {
+        case RADIAL:
+            // mostly extend the newest feeder, sometimes branch off anywhere
+            to = k + 1;
+            from = h % 5 ? k : (h >> 8) % (k + 1);
+            break;
+        case MESH:
+            from = k / 2;
+            to = k % 2 ? from + width : from + 1;
+            break;
+        case CHAIN: {
+            uint64_t p = k - k / 10; // the rows along the line so far
+            if (k % 10 == 9) {
+                from = p - 8;
+                to = p;
+            } else {
+                from = p;
+                to = p + 1;
+            }
+            break;
+        }
+        default: {
+            uint64_t v = hubs + k / 2;
+            from = v;
+            to = k % 2 && v > hubs ? v - 1 : h % hubs;
+            break;
+        }
+        }
+    }
+
+    /* whether row @k continues the edge of the row before it
+     */
+    bool continues(uint64_t k) const {
+        return k > 0 && mix(k ^ 0xC0FFEE) % 20 == 0;
+    }
+
+    /* the edge of row @k
+     */
+    uint64_t edge(uint64_t k) const {
+        while (continues(k))
+            --k;
+        return k;
+    }
+};
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+    while (b) {
+        uint64_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+static string vertex_id(uint64_t v) {
+    char buf[48];
+    snprintf(buf, sizeof buf, "{%08X-7E21-4A0D-8F55-%012llX}",
+        (unsigned)(mix(v) >> 32), (unsigned long long)v);
+    return buf;
+}
+
+static string edge_id(uint64_t e) {
+    char buf[48];
+    snprintf(buf, sizeof buf, "{%08X-0C4F-4B2E-9D3A-%012llX}",
+        (unsigned)(mix(~e) >> 32), (unsigned long long)e);
+    return buf;
+}
+
+/* picks @n distinct features of @net, junctions or edges as @edges is unset or
+ * set, from the stream @stream of randomness
+ */
+static vector<string> pick(const network &net, size_t n, bool edges,
+        uint64_t stream) {
+    vector<uint64_t> got;
+    for (uint64_t i = 0; got.size() < n && i < 64 * n; ++i) {
+        uint64_t h = mix(stream * 0x100000001B3ULL + i);
+        uint64_t f = edges ? net.edge(h % net.rows) : h % net.vertices();
+        if (find(got.begin(), got.end(), f) == got.end())
+            got.push_back(f);
+    }
+    vector<string> ids;
+    for (uint64_t f : got)
+        ids.push_back(edges ? edge_id(f) : vertex_id(f));
+    return ids;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s <radial|mesh|chain|hub> <rows> <out.json> "
+            "<out.txt> [vertex|edge] [ordered|shuffled|scattered] [seed]\n", argv[0]);
+        return 1;
+    }
+    const char *names[] = { "radial", "mesh", "chain", "hub" };
+    int topo = 0;
+    while (topo < 4 && strcmp(argv[1], names[topo]))
+        ++topo;
+    uint64_t rows = strtoull(argv[2], nullptr, 10);
+    bool edge_ctrls = argc > 5 && !strcmp(argv[5], "edge");
+    bool shuffled = argc > 6 && !strcmp(argv[6], "shuffled");
+    bool scattered = argc > 6 && !strcmp(argv[6], "scattered");
+    if (argc > 7)
+        seed = strtoull(argv[7], nullptr, 10);
+    if (topo == 4 || rows < 10) {
+        fprintf(stderr, "%s: unknown topology or fewer than 10 rows\n",
+            argv[0]);
+        return 1;
+    }
+    network net((topology)topo, rows);
+    // scattered rows are written in the order k -> (step*k + skew) mod rows,
+    // which is a permutation for step coprime to rows
+    uint64_t step = 1, skew = 0;
+    if (scattered) {
+        step = rows * 0.618 + 1;
+        while (gcd(step, rows) != 1)
+            ++step;
+        skew = mix(0x5CA77E4) % rows;
+    }
+
+    FILE *out = fopen(argv[3], "w");
+    FILE *sp = fopen(argv[4], "w");
+    if (!out || !sp) {
+        fprintf(stderr, "%s: cannot write the output files\n", argv[0]);
+        return 1;
+    }
+    static char buf[1 << 20];
+    setvbuf(out, buf, _IOFBF, sizeof buf);
+
+    vector<string> ctrls = pick(net, 4, edge_ctrls, 1);
+    string ctrl_list = "\"controllers\": [";
+    for (size_t i = 0; i < ctrls.size(); ++i) {
+        ctrl_list += (i ? ", " : "") + string("{\"globalId\": \"") + ctrls[i]
+            + "\", \"objectId\": " + to_string(i) + "}";
+    }
+    ctrl_list += "]";
+
+    fprintf(out, "{\"info\": {\"generator\": \"gen_network\", \"topology\": "
+        "\"%s\"},\n", names[topo]);
+    if (shuffled)
+        fprintf(out, "%s,\n", ctrl_list.c_str());
+    fprintf(out, "\"rows\": [\n");
+    for (uint64_t k = 0; k < rows; ++k) {
+        uint64_t j = (step * k + skew) % rows, from, to;
+        net.row(j, from, to);
+        string via = edge_id(net.edge(j)), u = vertex_id(from);
+        string v = vertex_id(to);
+        const char *sep = k + 1 < rows ? ",\n" : "\n";
+        if (!shuffled) {
+            fprintf(out, "{\"viaGlobalId\": \"%s\", \"fromTerminalId\": 1, "
+                "\"fromGlobalId\": \"%s\", \"toTerminalId\": 2, "
+                "\"toGlobalId\": \"%s\"}%s", via.c_str(), u.c_str(), v.c_str(),
+                sep);
+            continue;
+        }
+        string field[4] = {
+            "\"viaGlobalId\": \"" + via + "\"",
+            "\"fromGlobalId\": \"" + u + "\"",
+            "\"toGlobalId\": \"" + v + "\"",
+            "\"note\": \"[span {" + to_string(k % 97) + "}]\""
+        };
+        uint64_t h = mix(k ^ 0x5EED);
+        for (int i = 3; i > 0; --i)
+            swap(field[i], field[h % (i+1)]), h /= 4;
+        fprintf(out, "{%s, %s, %s, %s}%s", field[0].c_str(), field[1].c_str(),
+            field[2].c_str(), field[3].c_str(), sep);
+    }
+    fprintf(out, "]%s%s\n}\n", shuffled ? "" : ",\n",
+        shuffled ? "" : ctrl_list.c_str());
+
+    // half of the starting points are junctions, half edges
+    for (const string &id : pick(net, 5, false, 2))
+        fprintf(sp, "%s\n", id.c_str());
+    for (const string &id : pick(net, 5, true, 3))
+        fprintf(sp, "%s\n", id.c_str());
+    bool ok = !ferror(out) && !ferror(sp);
+    ok &= fclose(out) == 0;
+    ok &= fclose(sp) == 0;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+/* JSON Scanner Microbenchmark
+ * author: Zach Goldthorpe
+ *
+ * Builds a synthetic "rows" array in memory and times reading the three ID's
+ * out of every row, once with the original byte-at-a-time readc loop and once
+ * with each structural scanner kernel supported by this CPU. Every run must
+ * agree on a checksum of the extracted ID's.
+ *
+ * usage: scan_bench [rows] [repetitions]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include "json_fast.h"
+
+using namespace std;
+
+/* produces a json document of @rows rows shaped like the GIS Cup exports,
+ * including ignored keys whose values contain braces and brackets
+ */
+static string synthesise(uint_fast32_t rows) {
+    string out = "{\"info\": {\"name\": \"synthetic\"}, \"rows\": [\n";
+    char buf[256];
+    for (uint_fast32_t i = 0; i < rows; ++i) {
+        snprintf(buf, sizeof buf,
+            "{\"viaGlobalId\": \"{%08X-0C4F-4B2E-9D3A-%012X}\", "
+            "\"note\": \"[span {%u}]\", "
+            "\"fromGlobalId\": \"{%08X-7E21-4A0D-8F55-%012X}\", "
+            "\"toGlobalId\": \"{%08X-7E21-4A0D-8F55-%012X}\"},\n",
+            (unsigned)i, (unsigned)i, (unsigned)(i % 97),
+            (unsigned)(i / 2), (unsigned)(i / 2),
+            (unsigned)(i / 2 + 1), (unsigned)(i / 2 + 1));
+        out += buf;
+    }
+    out.resize(out.size() - 2); // trailing ",\n"
+    out += "\n], \"controllers\": []}\n";
+    return out;
+}
+
+// ==== the original byte-wise reader ==== //
+
+static bool bytewise_read_to_key(json_file &file, const char *key) {
+    uint_fast32_t level = file.braces, match = 0;
+    while (key[match] && level <= file.braces && !json_eof(file)) {
+        if (readc(file) == key[match])
+            ++match;
+        else
+            match = 0;
+    }
+    return !key[match];
+}
+
+static bool bytewise_begin_field(json_file &file) {
+    uint_fast32_t level = file.braces, stop = file.brackets;
+    while (level == file.braces && stop <= file.brackets && !json_eof(file))
+        readc(file);
+    return stop <= file.brackets && level != file.braces;
+}
+
+static void bytewise_end_field(json_file &file) {
+    uint_fast32_t level = file.braces;
+    while (level <= file.braces && !json_eof(file))
+        readc(file);
+}
+
+static void bytewise_begin_list(json_file &file) {
+    uint_fast32_t level = file.brackets, stop = file.braces;
+    while (level == file.brackets && stop <= file.braces && !json_eof(file))
+        readc(file);
+}
+
+static void bytewise_extract_string(json_file &file, jstr &out) {
+    while (!file.instring && !json_eof(file))
+        readc(file);
+    const char *start = file.pos;
+    while (file.instring && !json_eof(file))
+        readc(file);
+    out = jstr(start, file.pos - start - 1);
+}
+
+// ==== the two parses being compared ==== //
+
+static inline uint64_t digest(uint64_t sum, const jstr &id) {
+    return sum * 31 + id.n + (id.n ? (unsigned char)id.s[id.n / 2] : 0);
+}
+
+static uint64_t parse_bytewise(const string &doc) {
+    json_file file;
+    json_buffer(file, doc.data(), doc.size());
+    jstr edge, source, target;
+    uint64_t sum = 0;
+    bytewise_begin_field(file);
+    bytewise_read_to_key(file, "\"rows\"");
+    for (bytewise_begin_list(file); bytewise_begin_field(file);
+            bytewise_end_field(file)) {
+        bytewise_read_to_key(file, "\"viaGlobalId\"");
+        bytewise_extract_string(file, edge);
+        bytewise_read_to_key(file, "\"fromGlobalId\"");
+        bytewise_extract_string(file, source);
+        bytewise_read_to_key(file, "\"toGlobalId\"");
+        bytewise_extract_string(file, target);
+        sum = digest(digest(digest(sum, edge), source), target);
+    }
+    return sum;
+}
+
+static uint64_t parse_structural(const string &doc) {
+    json_file file;
+    json_buffer(file, doc.data(), doc.size());
+    jstr edge, source, target;
+    uint64_t sum = 0;
+    begin_field(file);
+    read_to_key(file, "\"rows\"");
+    for (begin_list(file); begin_field(file); end_field(file)) {
+        read_to_key(file, "\"viaGlobalId\"");
+        extract_string(file, edge);
+        read_to_key(file, "\"fromGlobalId\"");
+        extract_string(file, source);
+        read_to_key(file, "\"toGlobalId\"");
+        extract_string(file, target);
+        sum = digest(digest(digest(sum, edge), source), target);
+    }
+    return sum;
+}
+
+/* runs @parse @reps times over @doc, reporting the best throughput
+ */
+template<typename FUNC>
+static uint64_t measure(const char *label, const string &doc, int reps,
+        const FUNC &parse) {
+    double best = 0;
+    uint64_t sum = 0;
+    for (int r = 0; r < reps; ++r) {
+        auto start = chrono::steady_clock::now();
+        sum = parse(doc);
+        chrono::duration<double> secs = chrono::steady_clock::now() - start;
+        if (best == 0 || secs.count() < best)
+            best = secs.count();
+    }
+    printf("%-10s %10.1f MB/s  (%.3f s, checksum %016llx)\n", label,
+        doc.size() / best / 1e6, best, (unsigned long long)sum);
+    return sum;
+}
+
+int main(int argc, char **argv) {
+    uint_fast32_t rows = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    int reps = argc > 2 ? atoi(argv[2]) : 3;
+    string doc = synthesise(rows);
+    printf("%lu rows, %.1f MB, best of %d\n", (unsigned long)rows,
+        doc.size() / 1e6, reps);
+
+    uint64_t expect = measure("readc", doc, reps, parse_bytewise);
+    const json_scanner *kernels[] = {
+        &scanner_scalar, &scanner_sse42, &scanner_avx2
+    };
+    int status = 0;
+    for (const json_scanner *k : kernels) {
+        if (!scanner_supported(*k)) {
+            printf("%-10s unsupported on this CPU\n", k->name);
+            continue;
+        }
+        scanner = *k;
+        if (measure(k->name, doc, reps, parse_structural) != expect) {
+            printf("%-10s checksum mismatch!\n", k->name);
+            status = 1;
+        }
+    }
+    return status;
+}
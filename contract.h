@@ -0,0 +1,415 @@
+/* GRAPH CONTRACTION
+ * author: Zach Goldthorpe
+ *
+ * The file provides the optional pass shrinking the graph of the base network
+ * once it is built, so that traverse() only walks the part of it where the
+ * biconnected components can actually branch. Utility networks are mostly
+ * long runs of pipe or wire with service lines dangling off them, and neither
+ * takes any part in deciding which blocks lie between HEAD and TAIL.
+ *
+ * Two things are taken out of the graph:
+ *  trees:  every tree hanging off the rest of the graph by a single vertex
+ *          (and every component that is a tree on its own) is pruned, by
+ *          peeling vertices of degree 1 until none is left. A tree holds no
+ *          controller, so nothing in it is upstream of anything beyond it;
+ *          a starting point in it is upstream exactly along its path to the
+ *          vertex the tree hangs from, if that vertex is upstream.
+ *  chains: every maximal path through vertices of degree 2 is collapsed into
+ *          a single edge between its two ends. Subdividing an edge does not
+ *          change which blocks lie between HEAD and TAIL, so the chain is
+ *          upstream exactly when its edge is, that is when both of its ends
+ *          are [see upstream.cpp]. Cycles made only of such vertices are left
+ *          as they are.
+ * HEAD, TAIL and the vertices the controllers are attached to are never
+ * taken out. The vertices keep their numbers: those taken out simply have no
+ * arcs left, and their trees and chains are kept aside [see network.h].
+ *
+ * The starting points then go in as usual, unless they fall in what was
+ * taken out. One in a tree is moved to the vertex its tree hangs from, and its
+ * path there is written once that vertex is found upstream. One in a chain
+ * (or an edge of a chain) cuts the chain open there: the chain's edge is
+ * dropped from the overlay, and its pieces between the vertices cut are
+ * linked as edges of their own. The output sweep expands the chain edges and
+ * pieces it meets back into their vertices and edges.
+ *
+ * A contracted network cannot be saved to a snapshot (which keeps the whole
+ * graph) or reordered. The index does not read the graph, so the queries
+ * going through it gain nothing from the contraction.
+ *
+ * contract_network:        take the trees and chains out of the graph
+ * contract_startingpoints: attach the starting points to a contracted graph
+ * chain_features:          the features an edge of the overlay stands for
+ * hung_features:           the features of the starting points in trees
+ */
+
+#ifndef _contract_h_
+#define _contract_h_
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "read_graph.h"
+
+#define NOANCHOR UINT32_MAX // the anchor of a tree pruned as a whole
+#define NOCHAIN UINT32_MAX // the chain of a vertex left in the graph
+
+/* prunes the trees of the graph of the base network @net (built or loaded,
+ * and not reordered from then on), and collapses its chains of vertices of
+ * degree 2, keeping both in @net.contracted
+ */
+void contract_network(network &net);
+
+/* as set_startingpoints [see read_graph.h], on a network that has been
+ * contracted: the starting points in pruned trees are left in @ov.hung, and
+ * the chains they fall in are cut open
+ */
+void contract_startingpoints(overlay &ov, const std::vector<std::string> &ids);
+
+/* calls the function-type @action with every feature the edge @e of the
+ * overlay @ov stands for: its own feature, or those of the vertices and edges
+ * of the chain (or piece of a chain) it was collapsed from
+ */
+template<typename FUNC>
+static inline void chain_features(const overlay &ov, uintf e,
+    const FUNC &action);
+
+/* calls the function-type @action with the features along the paths of the
+ * starting points of @ov lying in pruned trees, for those hanging from a
+ * vertex marked in @upstream
+ */
+template<typename FUNC>
+void hung_features(const overlay &ov, const std::vector<bool> &upstream,
+    const FUNC &action);
+
+
+// ==== DEFINITIONS ==== //
+
+void contract_network(network &net) {
+    contraction &c = net.contracted;
+    csr &graph = net.graph;
+    uintf nodes = net.nodes;
+    if (c.built)
+        return;
+    // the vertices that are never taken out
+    std::vector<bool> fixed(nodes, false);
+    fixed[HEAD] = fixed[TAIL] = true;
+    for (uint32_t i = graph.first[TAIL]; i < graph.first[TAIL+1]; ++i)
+        fixed[graph.arcs[i].to] = true;
+
+    // peel the vertices of degree 1 (or 0), in the order they come to it, so
+    // that a vertex follows every vertex hanging from it
+    std::vector<bool> kept(nodes, true);
+    std::vector<uint32_t> degree(nodes), peeled;
+    c.anchor.resize(nodes);
+    c.hang.assign(nodes, arc{NOANCHOR, UNSPLIT});
+    for (uintf v = 0; v < nodes; ++v) {
+        degree[v] = graph.first[v+1] - graph.first[v];
+        c.anchor[v] = v;
+        if (!fixed[v] && degree[v] <= 1) {
+            kept[v] = false;
+            peeled.push_back(v);
+        }
+    }
+    for (size_t k = 0; k < peeled.size(); ++k) {
+        uint32_t v = peeled[k];
+        for (uint32_t i = graph.first[v]; i < graph.first[v+1]; ++i) {
+            uint32_t w = graph.arcs[i].to;
+            if (!kept[w])
+                continue;
+            c.hang[v] = graph.arcs[i];
+            if (--degree[w] <= 1 && !fixed[w]) {
+                kept[w] = false;
+                peeled.push_back(w);
+            }
+            break;
+        }
+    }
+    for (size_t k = peeled.size(); k-- > 0; ) {
+        uint32_t v = peeled[k];
+        c.anchor[v] = c.hang[v].to == NOANCHOR ? NOANCHOR
+            : c.anchor[c.hang[v].to];
+    }
+    net.stats.pruned = peeled.size();
+
+    // the vertices a chain may run through: kept, with two arcs left, neither
+    // of them a loop
+    std::vector<bool> inner(nodes, false);
+    for (uintf v = 0; v < nodes; ++v) {
+        if (!kept[v] || fixed[v] || degree[v] != 2)
+            continue;
+        inner[v] = true;
+        for (uint32_t i = graph.first[v]; i < graph.first[v+1]; ++i) {
+            if (graph.arcs[i].to == v)
+                inner[v] = false;
+        }
+    }
+    // the kept arc of vertex @v (with two of them) other than the arc @from
+    // by which it was entered
+    auto next = [&](uint32_t v, const arc &from) {
+        const arc *other = nullptr;
+        bool skipped = false;
+        for (uint32_t i = graph.first[v]; i < graph.first[v+1]; ++i) {
+            const arc &a = graph.arcs[i];
+            if (!kept[a.to])
+                continue;
+            if (!skipped && a.to == from.to && a.edge == from.edge)
+                skipped = true;
+            else
+                other = &a;
+        }
+        return *other;
+    };
+    // walk the chains out from their ends
+    c.chain.assign(nodes, NOCHAIN);
+    c.at.assign(nodes, 0);
+    for (uintf x = 0; x < nodes; ++x) {
+        if (!kept[x] || inner[x])
+            continue;
+        for (uint32_t i = graph.first[x]; i < graph.first[x+1]; ++i) {
+            arc a = graph.arcs[i];
+            if (!inner[a.to] || c.chain[a.to] != NOCHAIN)
+                continue;
+            uint32_t k = c.ends.size(), prev = x;
+            c.memberfirst.push_back(c.members.size());
+            while (inner[a.to]) {
+                uint32_t v = a.to;
+                c.members.push_back(a);
+                c.chain[v] = k;
+                c.at[v] = c.members.size() - c.memberfirst[k];
+                a = next(v, arc{prev, a.edge});
+                prev = v;
+            }
+            c.members.push_back(a);
+            c.ends.push_back(std::make_pair((uint32_t)x, a.to));
+            net.stats.chained += c.members.size() - c.memberfirst[k] - 1;
+        }
+    }
+    c.memberfirst.push_back(c.members.size());
+
+    // lay out what is left, a chain being entered by its edge
+    std::vector<uint32_t> first(nodes+1, 0);
+    std::vector<arc> arcs;
+    for (uintf v = 0; v < nodes; ++v) {
+        first[v+1] = first[v];
+        if (!kept[v] || c.chain[v] != NOCHAIN)
+            continue;
+        for (uint32_t i = graph.first[v]; i < graph.first[v+1]; ++i) {
+            arc a = graph.arcs[i];
+            if (!kept[a.to])
+                continue;
+            uint32_t k = c.chain[a.to];
+            if (k != NOCHAIN) {
+                a.to = c.ends[k].first == v ? c.ends[k].second
+                    : c.ends[k].first;
+                a.edge = net.edges + 1 + k;
+            }
+            arcs.push_back(a);
+            ++first[v+1];
+        }
+    }
+    graph.first.vec.swap(first);
+    graph.first.sync();
+    graph.arcs.vec.swap(arcs);
+    graph.arcs.sync();
+    c.built = true;
+}
+
+/* returns the vertex at position @pos along the chain @k of @c (its first end
+ * being at 0)
+ */
+static inline uint32_t chain_vertex(const contraction &c, uint32_t k,
+        uint32_t pos) {
+    return pos ? c.members[c.memberfirst[k] + pos-1].to : c.ends[k].first;
+}
+
+/* returns the number of edges of the chain @k of @c
+ */
+static inline uint32_t chain_length(const contraction &c, uint32_t k) {
+    return c.memberfirst[k+1] - c.memberfirst[k];
+}
+
+/* makes the starting point @v of the overlay @ov (a vertex left in the graph)
+ * explicit: if it lies in a chain, its position is added to @cuts, as a pair
+ * of the chain and twice the position
+ */
+static inline void expose(const overlay &ov, uint32_t v,
+        std::vector<std::pair<uint32_t, uint32_t> > &cuts) {
+    const contraction &c = ov.net->contracted;
+    if (c.chain[v] != NOCHAIN)
+        cuts.push_back(std::make_pair(c.chain[v], 2*c.at[v]));
+}
+
+/* hangs the path from @v (a vertex of a pruned tree, or its anchor) to its
+ * anchor from that anchor in the overlay @ov, after the features already in
+ * @ov.hungfeats from where the last path ended, and attaches the anchor to
+ * HEAD in its place
+ */
+static void hang_start(overlay &ov, uint32_t v,
+        std::vector<std::pair<uint32_t, uint32_t> > &cuts) {
+    const network &net = *ov.net;
+    const contraction &c = net.contracted;
+    uint32_t anchor = c.anchor[v];
+    if (anchor == NOANCHOR) {
+        // the whole tree was pruned, so it never reaches a controller
+        ov.hungfeats.resize(ov.hung.empty() ? 0 : ov.hung.back().second);
+        return;
+    }
+    for (; v != anchor; v = c.hang[v].to) {
+        ov.hungfeats.push_back(vertex_feature(ov, v));
+        ov.hungfeats.push_back(edge_feature(net, c.hang[v].edge));
+    }
+    ov.hung.push_back(std::make_pair(anchor, (uint32_t)ov.hungfeats.size()));
+    expose(ov, anchor, cuts);
+    add_link(ov, HEAD, anchor, net.edges);
+}
+
+/* attaches the feature named @id to HEAD in the overlay @ov on a contracted
+ * network, as attach() does [see read_graph.h], adding the chain positions it
+ * makes explicit to @cuts (as in expose) and the edges of chains it breaks
+ * down, as pairs of the chain and twice the position of the edge (that of its
+ * second end) plus 1
+ */
+static void contract_attach(overlay &ov, const jkey &id,
+        std::vector<std::pair<uint32_t, uint32_t> > &cuts) {
+    const network &net = *ov.net;
+    const contraction &c = net.contracted;
+    uintf v, e;
+    if ((v = net.idx.find(id)) != id_table::NONE) {
+        // the feature is a vertex
+        v += 2;
+        if (c.anchor[v] != v) {
+            hang_start(ov, v, cuts);
+        } else {
+            expose(ov, v, cuts);
+            add_link(ov, HEAD, v, net.edges);
+        }
+    }
+    if ((e = net.edgeidx.find(id)) == id_table::NONE)
+        return;
+    // the feature is an edge
+    uintf first = split_vertex(net, e, ov);
+    if (first != UNSPLIT) {
+        // the edge has been broken down already (as a controller, which is
+        // never contracted, or as a starting point)
+        uintf pairs = net.edgefirst[e+1] - net.edgefirst[e];
+        for (v = first; v < first + pairs; ++v)
+            add_link(ov, HEAD, v, net.edges);
+        return;
+    }
+    ov.edgevtx[e] = ov.nodes;
+    size_t made = cuts.size(); // the cuts made by this edge
+    for (uintf i = net.edgefirst[e]; i < net.edgefirst[e+1]; ++i) {
+        ov.split.push_back(e);
+        uint32_t source = ov.nodes++;
+        uint32_t x = net.edgenodes[i].first, y = net.edgenodes[i].second;
+        if (c.anchor[x] != x || c.anchor[y] != y) {
+            // the pair lies in a pruned tree: the end further out is a dead
+            // end, so the edge is upstream along the path of the other end,
+            // and its vertex is left without arcs
+            if (c.anchor[x] != x && c.hang[x].to == y
+                    && c.hang[x].edge == e)
+                std::swap(x, y);
+            ov.hungfeats.push_back(edge_feature(net, e));
+            hang_start(ov, x, cuts);
+            continue;
+        }
+        uint32_t inner = c.chain[x] != NOCHAIN ? x : y;
+        uint32_t k = c.chain[inner];
+        if (k != NOCHAIN) {
+            // the pair is an edge of a chain (entering or leaving the vertex
+            // inner), which the chain drops
+            uint32_t other = inner == x ? y : x, pos = c.at[inner];
+            const arc &in = c.members[c.memberfirst[k] + pos-1];
+            uint32_t slot = pos+1;
+            if (in.edge == e && chain_vertex(c, k, pos-1) == other
+                    && std::find(cuts.begin() + made, cuts.end(),
+                        std::make_pair(k, 2*pos+1)) == cuts.end())
+                slot = pos;
+            cuts.push_back(std::make_pair(k, 2*(slot-1)));
+            cuts.push_back(std::make_pair(k, 2*slot));
+            cuts.push_back(std::make_pair(k, 2*slot+1));
+        }
+        add_link(ov, HEAD, source, net.edges);
+        add_link(ov, source, x, net.edges);
+        add_link(ov, source, y, net.edges);
+    }
+}
+
+void contract_startingpoints(overlay &ov, const std::vector<std::string> &ids) {
+    const network &net = *ov.net;
+    const contraction &c = net.contracted;
+    clear_overlay(ov);
+    std::vector<std::pair<uint32_t, uint32_t> > cuts;
+    for (const std::string &id : ids)
+        contract_attach(ov, jkey(id), cuts);
+
+    // link the pieces of every chain cut open between its vertices made
+    // explicit, leaving out the edges broken down
+    std::sort(cuts.begin(), cuts.end());
+    cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+    uint32_t pieces = net.edges + 1 + c.ends.size();
+    for (size_t i = 0; i < cuts.size(); ) {
+        uint32_t k = cuts[i].first, from = 0;
+        for (; i < cuts.size() && cuts[i].first == k; ++i) {
+            uint32_t to = cuts[i].second / 2;
+            if (cuts[i].second % 2 || to == from)
+                continue;
+            if (i+1 < cuts.size() && cuts[i+1] == std::make_pair(k, 2*to+1))
+                ; // the edge between from and to was broken down
+            else
+                ov.pieces.push_back(chain_piece{k, from, to});
+            from = to;
+        }
+        if (from != chain_length(c, k))
+            ov.pieces.push_back(chain_piece{k, from, chain_length(c, k)});
+        ov.cut.insert(net.edges + 1 + k);
+    }
+    for (size_t j = 0; j < ov.pieces.size(); ++j) {
+        const chain_piece &p = ov.pieces[j];
+        add_link(ov, chain_vertex(c, p.chain, p.from),
+            chain_vertex(c, p.chain, p.to), pieces + j);
+    }
+    build_overlay(ov);
+}
+
+template<typename FUNC>
+static inline void chain_features(const overlay &ov, uintf e,
+        const FUNC &action) {
+    const network &net = *ov.net;
+    if (e <= net.edges) {
+        action(edge_feature(net, e));
+        return;
+    }
+    const contraction &c = net.contracted;
+    uint32_t k = e - net.edges - 1, from = 0, to;
+    if (k < c.ends.size()) {
+        to = chain_length(c, k);
+    } else {
+        const chain_piece &p = ov.pieces[k - c.ends.size()];
+        k = p.chain;
+        from = p.from;
+        to = p.to;
+    }
+    for (uint32_t i = c.memberfirst[k] + from; i < c.memberfirst[k] + to;
+            ++i) {
+        action(edge_feature(net, c.members[i].edge));
+        if (i+1 < c.memberfirst[k] + to)
+            action(vertex_feature(ov, c.members[i].to));
+    }
+}
+
+template<typename FUNC>
+void hung_features(const overlay &ov, const std::vector<bool> &upstream,
+        const FUNC &action) {
+    uint32_t begin = 0;
+    for (const std::pair<uint32_t, uint32_t> &h : ov.hung) {
+        if (upstream[h.first]) {
+            for (uint32_t i = begin; i < h.second; ++i)
+                action(ov.hungfeats[i]);
+        }
+        begin = h.second;
+    }
+}
+
+#endif
@@ -0,0 +1,76 @@
+/* FLAT ARRAYS
+ * author: Zach Goldthorpe
+ *
+ * The file provides the array type backing the graph and the ID tables. Its
+ * elements either live in a vector it owns (when the network is built from the
+ * JSON) or inside a read-only mapping (when it is loaded from a snapshot, see
+ * snapshot.h); readers go through the same pointer in both cases.
+ */
+
+#ifndef _flat_h_
+#define _flat_h_
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+template<typename T>
+struct flat {
+    std::vector<T> vec; // the elements, while they are owned
+
+    /* points the array at the elements of vec; this must be called again
+     * whenever vec is modified
+     */
+    void sync() {
+        ptr = vec.data();
+        len = vec.size();
+    }
+
+    /* points the array at the @n elements at @p, which must outlive it
+     */
+    void borrow(const T *p, size_t n) {
+        std::vector<T>().swap(vec);
+        ptr = p;
+        len = n;
+    }
+
+    /* makes the array own its elements again, so that vec may be modified
+     */
+    void own() {
+        if (ptr != vec.data() || len != vec.size()) {
+            std::vector<T> copy(ptr, ptr + len);
+            vec.swap(copy);
+            sync();
+        }
+    }
+
+    bool owned() const { return ptr == vec.data(); }
+    const T &operator[](size_t i) const { return ptr[i]; }
+    const T *data() const { return ptr; }
+    size_t size() const { return len; }
+    bool empty() const { return !len; }
+
+private:
+    const T *ptr = nullptr;
+    size_t len = 0;
+};
+
+/* a bitmap kept in 64-bit words
+ */
+using bitmap = flat<uint64_t>;
+
+/* returns bit @i of @b (bits past the end are unset)
+ */
+static inline bool test_bit(const bitmap &b, size_t i) {
+    return (i >> 6) < b.size() && (b[i >> 6] >> (i & 63) & 1);
+}
+
+/* sets bit @i of the owned bitmap @b, growing it as necessary
+ */
+static inline void set_bit(bitmap &b, size_t i) {
+    if (b.vec.size() <= i >> 6)
+        b.vec.resize((i >> 6) + 1, 0);
+    b.vec[i >> 6] |= 1ULL << (i & 63);
+    b.sync();
+}
+
+#endif
@@ -0,0 +1,253 @@
+/* ID TABLE
+ * author: Zach Goldthorpe
+ *
+ * The file provides the hash table translating global ID's into the dense
+ * indices used by the graph. It is a flat open-addressing table with linear
+ * probing: a slot holds 32 bits of the ID's hash next to its index, so a probe
+ * only touches the key bytes once the hashes agree. The keys themselves are
+ * copied back to back into a single arena in order of insertion, which also
+ * lets the table serve as the index-to-name lookup. A GUID is stored, hashed
+ * and compared packed into 17 bytes rather than as its 38 bytes of text [see
+ * json_file.h], and only turned back into text by name().
+ *
+ * Indices are handed out as 0, 1, 2, ... in order of insertion, and only change
+ * if the table is permuted afterwards.
+ *
+ * The slots, arena and offsets are flat arrays, so a table can be saved in a
+ * snapshot and used straight from its mapping; the per-key hashes are only
+ * kept (or recomputed) while the table is being inserted into.
+ *
+ * A fingerprint table keeps no keys at all, only the 64-bit hash of each ID
+ * and a 32-bit check hash computed independently of it, and tells ID's apart
+ * by the two together. ID's whose hashes agree but whose checks do not are
+ * kept apart and counted as collisions; only ID's agreeing in all 96 bits
+ * would be merged. Such a table cannot name its ID's (key() is not available)
+ * nor be saved in a snapshot.
+ */
+
+#ifndef _id_table_h_
+#define _id_table_h_
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "flat.h"
+#include "json_file.h"
+
+struct id_table {
+    // returned by find for an ID not in the table
+    static const uint_fast32_t NONE = UINT32_MAX;
+
+    /* returns the index of @id, or NONE if it is not in the table
+     */
+    uint_fast32_t find(const jkey &id) const;
+
+    /* returns the index of @id, inserting it with the next index if it is not
+     * in the table yet; @added records whether it was inserted
+     */
+    uint_fast32_t insert(const jkey &id, bool &added);
+
+    /* returns the ID of index @i as stored (resp. its hash)
+     */
+    jstr key(uint_fast32_t i) const {
+        return jstr(arena.data() + offset[i], offset[i+1] - offset[i]);
+    }
+    uint64_t hash(uint_fast32_t i) const { return hashes[i]; }
+
+    /* returns the text of the ID of index @i, written to the GUID_TEXT bytes
+     * at @buf if it is a packed GUID
+     */
+    jstr name(uint_fast32_t i, char *buf) const {
+        jstr k = key(i);
+        if (!guid_packed(k))
+            return k;
+        guid_text(k.s, buf);
+        return jstr(buf, GUID_TEXT);
+    }
+
+    uint_fast32_t size() const {
+        return fingerprint ? hashes.size() : offset.size() - 1;
+    }
+
+    /* prepares the table for about @ids ID's totalling about @bytes bytes
+     */
+    void reserve(size_t ids, size_t bytes);
+
+    /* renumbers the ID's so that the one of index @order[i] gets index i, for
+     * @order a permutation of the indices
+     */
+    void permute(const std::vector<uint32_t> &order);
+
+    struct slot {
+        uint32_t tag; // the upper half of the hash
+        uint32_t idx; // one more than the index, or 0 if the slot is empty
+    };
+    flat<slot> slots; // power-of-two sized, at most half full
+    flat<char> arena; // the keys, back to back
+    flat<uint64_t> offset; // key i is arena[offset[i]..offset[i+1])
+    uint64_t probes = 0; // the slots insert has probed [see stats.h]
+    // set (while the table is empty) to keep fingerprints instead of keys,
+    // and the ID's inserted so far whose hash was already taken
+    bool fingerprint = false;
+    uint64_t collisions = 0;
+
+    id_table() {
+        offset.vec.push_back(0);
+        offset.sync();
+    }
+
+private:
+    std::vector<uint64_t> hashes; // the hash of each key
+    std::vector<uint32_t> checks; // the check hash of each key (fingerprints)
+
+    bool same(uint_fast32_t i, const jkey &id, uint32_t check) const {
+        return fingerprint ? hashes[i] == id.hash && checks[i] == check
+            : key(i) == id.stored();
+    }
+
+    void thaw();
+    void grow(size_t capacity);
+};
+
+
+// ==== DEFINITIONS ==== //
+
+/* the check hash of the stored ID @id (32-bit FNV-1a), which is unrelated to
+ * hash_id
+ */
+static inline uint32_t check_id(const jstr &id) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < id.n; ++i)
+        h = (h ^ (unsigned char)id.s[i]) * 16777619u;
+    return h;
+}
+
+uint_fast32_t id_table::find(const jkey &id) const {
+    if (slots.empty())
+        return NONE;
+    size_t mask = slots.size() - 1;
+    uint32_t tag = id.hash >> 32;
+    uint32_t check = fingerprint ? check_id(id.stored()) : 0;
+    for (size_t i = id.hash & mask; slots[i].idx; i = (i+1) & mask) {
+        if (slots[i].tag == tag && same(slots[i].idx-1, id, check))
+            return slots[i].idx-1;
+    }
+    return NONE;
+}
+
+uint_fast32_t id_table::insert(const jkey &id, bool &added) {
+    if (!slots.owned())
+        thaw();
+    if (2*(size()+1) > slots.size())
+        grow(slots.empty() ? 16 : 2*slots.size());
+    size_t mask = slots.size() - 1, i;
+    uint32_t tag = id.hash >> 32;
+    uint32_t check = fingerprint ? check_id(id.stored()) : 0;
+    bool taken = false; // whether another ID has the same hash
+    // the probes are counted once the probing stops, from how far it went, so
+    // that the loop costs the same whether or not they are reported
+    size_t home = id.hash & mask;
+    for (i = home; slots[i].idx; i = (i+1) & mask) {
+        if (slots[i].tag != tag)
+            continue;
+        if (same(slots[i].idx-1, id, check)) {
+            probes += ((i - home) & mask) + 1;
+            added = false;
+            return slots[i].idx-1;
+        }
+        taken |= fingerprint && hashes[slots[i].idx-1] == id.hash;
+    }
+    probes += ((i - home) & mask) + 1;
+    added = true;
+    slots.vec[i].tag = tag;
+    slots.vec[i].idx = size()+1;
+    if (fingerprint) {
+        checks.push_back(check);
+        collisions += taken;
+    } else {
+        jstr k = id.stored();
+        arena.vec.insert(arena.vec.end(), k.s, k.s + k.n);
+        arena.sync();
+        offset.vec.push_back(arena.size());
+        offset.sync();
+    }
+    hashes.push_back(id.hash);
+    return size()-1;
+}
+
+void id_table::reserve(size_t ids, size_t bytes) {
+    size_t capacity = 16;
+    while (capacity < 2*ids)
+        capacity *= 2;
+    if (capacity > slots.size())
+        grow(capacity);
+    if (fingerprint) {
+        checks.reserve(ids);
+        hashes.reserve(ids);
+        return;
+    }
+    arena.vec.reserve(bytes);
+    arena.sync();
+    offset.vec.reserve(ids+1);
+    offset.sync();
+    hashes.reserve(ids);
+}
+
+void id_table::permute(const std::vector<uint32_t> &order) {
+    if (!slots.owned())
+        thaw();
+    std::vector<uint64_t> h(order.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        h[i] = hashes[order[i]];
+    if (fingerprint) {
+        std::vector<uint32_t> c(order.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            c[i] = checks[order[i]];
+        checks.swap(c);
+    } else {
+        std::vector<char> a;
+        std::vector<uint64_t> off(1, 0);
+        a.reserve(arena.size());
+        off.reserve(offset.size());
+        for (uint32_t k : order) {
+            jstr key = this->key(k);
+            a.insert(a.end(), key.s, key.s + key.n);
+            off.push_back(a.size());
+        }
+        arena.vec.swap(a);
+        arena.sync();
+        offset.vec.swap(off);
+        offset.sync();
+    }
+    hashes.swap(h);
+    grow(slots.size());
+}
+
+/* takes ownership of a table borrowed from a snapshot, recomputing the hashes
+ * its slots do not keep in full
+ */
+void id_table::thaw() {
+    slots.own();
+    arena.own();
+    offset.own();
+    hashes.resize(size());
+    for (uint_fast32_t k = 0; k < size(); ++k)
+        hashes[k] = hash_id(key(k).s, key(k).n);
+}
+
+/* rebuilds the slots with @capacity (a power of two) slots, placing every key
+ * again from its stored hash
+ */
+void id_table::grow(size_t capacity) {
+    slots.vec.assign(capacity, slot{0, 0});
+    slots.sync();
+    size_t mask = capacity - 1;
+    for (uint_fast32_t k = 0; k < size(); ++k) {
+        size_t i = hashes[k] & mask;
+        while (slots[i].idx)
+            i = (i+1) & mask;
+        slots.vec[i].tag = hashes[k] >> 32;
+        slots.vec[i].idx = k+1;
+    }
+}
+
+#endif
@@ -5,22 +5,54 @@
  * the GIS CUP 2018 specifications, aimed to read in a single sweep while
  * avoiding as much overhead computation as possible.
  *
+ * json_keys:      the keywords scan_field looks for, measured once
  * scan_field:     parse a key-value dictionary (field) for specific keywords
  *                 and perform prescribed actions based on which keyword is read
  * scan_list:      run through a list of items performing a prescribed action
- * extract_string: scan and extract a string from the file
+ *
+ * scan_field reads the strings of a field whole, jumping from one quote to the
+ * next with the structural kernels of json_scan.h, and dispatches each string
+ * followed by a colon (a key) on its length before comparing it with the keys
+ * of that length, so that a field costs about as much as it does the fast
+ * reader whatever the number of keys.
+ *
+ * the input itself is read through the memory-mapped backend in json_file.h,
+ * which also provides extract_string
  */
 
 #ifndef _json_h_
 #define _json_h_
-#include <cstdio>
 #include <cstdint>
-#include <string>
+#include <cstring>
+#include "json_file.h"
+
+/* the trigger words of scan_field, each a key in double quotes (which must
+ * outlive the object): len stores the length of each key inside its quotes,
+ * and lens has bit n set if some key is n bytes long (up to 63), to reject most
+ * strings at once. A caller keeps its keys in a static object, so that they
+ * are only measured once rather than on every field.
+ *
+ * template param N: number of keys
+ */
+template<uint_fast32_t N>
+struct json_keys {
+    const char *key[N];
+    size_t len[N];
+    uint64_t lens = 0;
+
+    json_keys(const char *const (&keys)[N]) {
+        for (uint_fast32_t i = 0; i < N; ++i) {
+            key[i] = keys[i];
+            len[i] = strlen(keys[i]) - 2;
+            lens |= len[i] < 64 ? uint64_t(1) << len[i] : 0;
+        }
+    }
+};
 
 /* reads the next field of the json @file (enclosed by braces "{...}") and scans
- * for the trigger words provided by the array @keys. Once a key has been fully
- * read, the function calls the function-type @action passing the index of the
- * key read as its only argument.
+ * for the trigger words @keys. Once a key of the field has been fully read,
+ * the function calls the function-type @action passing the index of the key
+ * read as its only argument, with the @file positioned just after the key.
  *
  * returns true if it ever reached a field to scan
  *
@@ -28,7 +60,7 @@
  * template param FUNC: function-type accepting a single int and returns nothing
  */
 template<uint_fast32_t N, typename FUNC>
-bool scan_field(FILE *file, const char *const (&keys)[N], const FUNC &action);
+bool scan_field(json_file &file, const json_keys<N> &keys, const FUNC &action);
 
 /* reads the next list of the json @file (enclosed by brackets "[...]") and
  * repeatedly calls the function-type @action until it exits the list.
@@ -38,99 +70,65 @@ bool scan_field(FILE *file, const char *const (&keys)[N], const FUNC &action);
  * template param FUNC: function-type accepting no arguments and returns nothing
  */
 template<typename FUNC>
-bool scan_list(FILE *file, const FUNC &action);
-
-/* scans the json @file for the next string (enclosed by double quotes "...")
- * and writes it to @out
- */
-void extract_string(FILE *file, std::string &out);
+bool scan_list(json_file &file, const FUNC &action);
 
 
 // ==== DEFINITIONS ==== //
 
-static uint_fast32_t braces, brackets; // tracks the brace and bracket levels
-static bool instring; // tracks whether inside a string or not
-
-/* reads the next character of the json @file, while also tracking bookkeeping
- * information (braces, brackets, instring defined above)
- *
- * returns the read character
+/* returns whether the string the json @file has just read is followed by a
+ * colon, that is whether it is a key
  */
-static char readc(FILE *file) {
-    char c = fgetc_unlocked(file);
-    if (c == '"') {
-        // entered or exited a string
-        instring = !instring;
-        return c;
-    }
-    if (instring)
-        return c; // character holds no other meaning if inside a string
-
-    switch (c) {
-        case '{':
-        ++braces; // entered a new field
-        break;
-        case '}':
-        --braces; // exited a field
-        break;
-        case '[':
-        ++brackets; // entered a new list
-        break;
-        case ']':
-        --brackets; // exited a list
-        break;
-        default: // otherwise it is an ordinary character, so do nothing
-        break;
-    }
-    return c;
-}
-
-void extract_string(FILE *file, std::string &out) {
-    while (!instring) readc(file); // read to next string
-    out.clear();
-    for (char c = readc(file); instring; c = readc(file))
-        out.push_back(c); // extract string
-    out.push_back('\n');
+static inline bool at_key(json_file &file) {
+    const char *p = file.pos;
+    while (json_more(file, p, 1) && (*p == ' ' || *p == '\n' || *p == '\r'
+            || *p == '\t'))
+        ++p;
+    return json_more(file, p, 1) && *p == ':';
 }
 
 template<uint_fast32_t N, typename FUNC>
-bool scan_field(FILE *file, const char *const (&keys)[N], const FUNC &action) {
-    uint_fast32_t pos[N], bracelevel = braces, bracketlevel = brackets;
-    // pos tracks string matching with each key
+bool scan_field(json_file &file, const json_keys<N> &keys, const FUNC &action) {
+    uint_fast32_t bracelevel = file.braces, bracketlevel = file.brackets;
     // bracelevel/bracketlevel store the initial state of the file before scan
-
-    for (uint_fast32_t i = 0; i < N; ++i)
-        pos[i] = 0;
-    while (bracelevel == braces) {
-        readc(file); // read into next field
-        if (bracketlevel > brackets)
+    while (bracelevel == file.braces) {
+        next_level(file); // read into next field
+        if (bracketlevel > file.brackets || json_eof(file))
             return false; // no field to read
     }
-    while (bracelevel < braces) {
-        char c = readc(file);
-        if (bracelevel+1 < braces || bracketlevel < brackets)
+    while (bracelevel < file.braces && !json_eof(file)) {
+        if (bracelevel+1 < file.braces || bracketlevel < file.brackets) {
+            next_level(file); // nested values cannot hold the keys
             continue;
+        }
+        if (next_token(file) != '"' || !file.instring)
+            continue; // only the start of a string can start a key
+        const char *start = file.pos;
+        next_token(file); // the closing quote
+        if (file.instring)
+            break; // ran out of input
+        size_t n = file.pos - 1 - start;
+        if ((n < 64 && !(keys.lens >> n & 1)) || !at_key(file))
+            continue; // a value, or a key of no interest
         for (uint_fast32_t i = 0; i < N; ++i) {
-            if (c == keys[i][pos[i]]) {
-                ++pos[i]; // update match with key i
-                if (keys[i][pos[i]] == '\0')
-                    action(i); // key fully matched
-            } else pos[i] = 0; // otherwise, no match so restart
+            if (n == keys.len[i] && !memcmp(start, keys.key[i] + 1, n)) {
+                action(i); // key fully matched
+                break;
+            }
         }
     }
     return true;
 }
 
 template<typename FUNC>
-bool scan_list(FILE *file, const FUNC &action) {
-    uint_fast32_t bracketlevel = brackets, bracelevel = braces;
+bool scan_list(json_file &file, const FUNC &action) {
+    uint_fast32_t bracketlevel = file.brackets, bracelevel = file.braces;
     // store initial state of the file before scan
-    while (bracketlevel == brackets) {
-        readc(file); // read into next list
-        if (bracelevel > braces)
+    while (bracketlevel == file.brackets) {
+        next_level(file); // read into next list
+        if (bracelevel > file.braces || json_eof(file))
             return false; // no list to read
     }
-    while (bracketlevel < brackets)
+    while (bracketlevel < file.brackets && !json_eof(file))
         action(); // repeatedly call until list exited
     return true;
 }
@@ -10,123 +10,88 @@
  * end_field:      scan the input until a field is entered or exited
  * begin_list /
  * end_list:       scan the input until a list is entered or exited
- * extract_string: scan and extract a string from the file
+ *
+ * the input itself is read through the memory-mapped backend in json_file.h,
+ * which also provides extract_string
  */
 
 #ifndef _json_h_fast
 #define _json_h_fast
-#include <cstdio>
 #include <cstdint>
-#include <string>
+#include <cstring>
+#include "json_file.h"
 
-/* scans the json @file until it reads the entire @key
+/* scans the json @file until it reads the entire @key, which must start with
+ * a double quote (as any quoted json key does)
  *
  * returns true if the key is successfully read
  */
-bool read_to_key(FILE *file, const char *key);
+bool read_to_key(json_file &file, const char *key);
 
 /* these scan the json @file until the field (enclosed by braces {...}) has been
  * entered or exited.
  *
  * begin_field returns true if a new field has been entered.
  */
-bool begin_field(FILE *file);
-void end_field(FILE *file);
+bool begin_field(json_file &file);
+void end_field(json_file &file);
 
 /* similarly, these scan the json @file until the list (enclosed by brackets
  * [...]) has been entered or exited.
  *
  * begin_list returns true if a new list has been entered.
  */
-bool begin_list(FILE *file);
-void end_list(FILE *file);
-
-/* scans the json @file for the next string (enclosed by double quotes "...")
- * and writes it to @out
- */
-void extract_string(FILE *file, std::string &out);
+bool begin_list(json_file &file);
+void end_list(json_file &file);
 
 
 // ==== DEFINITIONS ==== //
 
-static uint_fast32_t braces, brackets; // tracks the brace and bracket levels
-static bool instring; // tracks whether inside a string or not
-
-/* reads the next character of the json @file, while also tracking bookkeeping
- * information (braces, brackets, instring defined above)
- *
- * returns the read character
- */
-static char readc(FILE *file) {
-    char c = fgetc_unlocked(file);
-    if (c == '"') {
-        // entered or exited a string
-        instring = !instring;
-        return c;
-    }
-    if (instring)
-        return c; // character holds no other meaning if inside a string
-
-    switch (c) {
-        case '{':
-        ++braces; // entered a new field
-        break;
-        case '}':
-        --braces; // exited a field
-        break;
-        case '[':
-        ++brackets; // entered a new list
-        break;
-        case ']':
-        --brackets; // exited a list
-        break;
-        default: // otherwise it is an ordinary character, so do nothing
-        break;
-    }
-    return c;
-}
-
-void extract_string(FILE *file, std::string &out) {
-    while (!instring) readc(file); // read to next string
-    out.clear();
-    for (char c = readc(file); instring; c = readc(file))
-        out.push_back(c); // extract string
-    out.push_back('\n');
-}
-
-bool read_to_key(FILE *file, const char *key) {
-    uint_fast32_t level = braces, match = 0;
-    while (key[match] && level <= braces) {
-        if (readc(file) == key[match])
-            ++match;
-        else
-            match = 0;
+bool read_to_key(json_file &file, const char *key) {
+    uint_fast32_t level = file.braces;
+    size_t len = strlen(key);
+    bool quoted = false; // whether the key leaves the file inside a string
+    for (size_t i = 0; i < len; ++i)
+        quoted ^= key[i] == '"';
+    while (level <= file.braces) {
+        char c = next_token(file);
+        if (c == '\0')
+            return false;
+        if (c != '"' || !file.instring)
+            continue; // only the start of a string can start the key
+        const char *start = file.pos - 1;
+        if (json_more(file, start, len) && !memcmp(start, key, len)) {
+            file.pos = start + len;
+            file.instring = quoted;
+            return true;
+        }
+        next_token(file); // skip the rest of the string
     }
-    return !key[match];
+    return false;
 }
 
-bool begin_field(FILE *file) {
-    uint_fast32_t level = braces, stop = brackets;
-    while (level == braces && stop <= brackets)
-        readc(file); // read until new field entered or list level exited
-    return stop <= brackets;
+bool begin_field(json_file &file) {
+    uint_fast32_t level = file.braces, stop = file.brackets;
+    while (level == file.braces && stop <= file.brackets && !json_eof(file))
+        next_level(file); // read until new field entered or list level exited
+    return stop <= file.brackets && level != file.braces;
 }
-void end_field(FILE *file) {
-    uint_fast32_t level = braces;
-    while (level <= braces)
-        readc(file); // read until field exited
+void end_field(json_file &file) {
+    uint_fast32_t level = file.braces;
+    while (level <= file.braces && !json_eof(file))
+        next_level(file); // read until field exited
 }
 
-bool begin_list(FILE *file) {
-    uint_fast32_t level = brackets, stop = braces;
-    while (level == brackets && stop <= braces)
-        readc(file); // read until new list entered or field level exited
-    return stop <= braces;
+bool begin_list(json_file &file) {
+    uint_fast32_t level = file.brackets, stop = file.braces;
+    while (level == file.brackets && stop <= file.braces && !json_eof(file))
+        next_level(file); // read until new list entered or field level exited
+    return stop <= file.braces && level != file.brackets;
 }
-void end_list(FILE *file) {
-    uint_fast32_t level = brackets;
-    while (level <= brackets)
-        readc(file); // read until list exited
+void end_list(json_file &file) {
+    uint_fast32_t level = file.brackets;
+    while (level <= file.brackets && !json_eof(file))
+        next_level(file); // read until list exited
 }
 
 
@@ -0,0 +1,502 @@
+/* JSON Input Backend
+ * author: Zach Goldthorpe
+ *
+ * The file provides the memory-mapped input shared by both JSON parsers. The
+ * whole file is mapped read-only and scanned in place, so no byte is copied on
+ * its way to the parser and extracted strings are views into the mapping.
+ *
+ * A compressed file is instead decompressed into memory on a thread of its own
+ * as the parser goes [see json_stream.h]: the end of the input is then only
+ * the end of what is decompressed so far, and json_more waits for more
+ * whenever the parser reaches it.
+ *
+ * json_open:      map (or start decompressing) a file for a sequential scan
+ * json_buffer:    scan a buffer already in memory instead
+ * json_close:     release the mapping
+ * json_release:   drop the part of the mapping already read from memory
+ * json_more:      make sure some bytes ahead are in memory
+ * json_load:      wait until the whole input is in memory
+ * json_expected:  the expected size of the input
+ * json_tell /
+ * json_seek:      note the read position, and go back to it
+ * extract_string: scan and extract a string from the file
+ *
+ * next_token / next_level jump from one structural character to the next using
+ * the vectorised kernels of json_scan.h, keeping the same bookkeeping as readc.
+ *
+ * ID's shaped as the braced upper-case GUID's ArcGIS writes, such as
+ * "{8A1C35F0-6D2B-4E7A-9C11-03B4D5E6F789}", are packed into 17 bytes (a NUL
+ * marker and the 16 bytes of the GUID) by guid_pack and turned back into text
+ * by guid_text. A jkey keeps the packed form of such an ID, which is the form
+ * the ID tables hash, compare and store [see id_table.h]; other ID's are kept
+ * as they are. No ID read from JSON starts with a NUL, so the two forms never
+ * mix up, and packed GUID's compare with memcmp in the order of their text.
+ * The digits are decoded eight at a time, which assumes a little-endian host
+ * (as the snapshots do).
+ */
+
+#ifndef _json_file_h_
+#define _json_file_h_
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "json_scan.h"
+#include "json_stream.h"
+
+/* a view of a string living inside some other buffer (usually the mapping)
+ */
+struct jstr {
+    const char *s;
+    size_t n;
+    jstr() : s(nullptr), n(0) {}
+    jstr(const char *s, size_t n) : s(s), n(n) {}
+    jstr(const std::string &str) : s(str.data()), n(str.size()) {}
+    bool operator==(const jstr &o) const {
+        return n == o.n && !memcmp(s, o.s, n);
+    }
+};
+
+/* hashes the @n bytes at @s, a word at a time
+ */
+static inline uint64_t hash_id(const char *s, size_t n) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ n, w;
+    for (; n >= 8; s += 8, n -= 8) {
+        memcpy(&w, s, 8);
+        h = (h ^ w) * 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 31;
+    }
+    w = 0;
+    memcpy(&w, s, n);
+    h = (h ^ w) * 0x94D049BB133111EBULL;
+    return h ^ (h >> 29);
+}
+
+// the length of the text of a braced GUID, and of its packed form
+#define GUID_TEXT 38
+#define GUID_PACKED 17
+
+/* decodes the 8 upper-case hex digits of the word @w (in the order they were
+ * read, a little-endian load) into the 4 bytes at @out
+ *
+ * returns false if any byte of @w is not such a digit
+ */
+static inline bool guid_word(uint64_t w, char *out) {
+    const uint64_t ones = 0x0101010101010101ULL, high = 0x8080808080808080ULL;
+    // with the high bits clear, adding to a byte never carries into the next
+    uint64_t digit = (w + 0x50*ones) & ~(w + 0x46*ones); // '0'..'9'
+    uint64_t upper = (w + 0x3F*ones) & ~(w + 0x39*ones); // 'A'..'F'
+    if ((w & high) || ((digit | upper) & high) != high)
+        return false;
+    uint64_t v = (w & 0x0F*ones) + 9 * ((w >> 6) & ones);
+    // pair the nibbles into bytes, then close the gaps between the bytes
+    v = (v << 4 | v >> 8) & 0x00FF00FF00FF00FFULL;
+    v = (v | v >> 8) & 0x0000FFFF0000FFFFULL;
+    v = (v | v >> 16) & 0xFFFFFFFFULL;
+    uint32_t b = (uint32_t)v;
+    memcpy(out, &b, 4);
+    return true;
+}
+
+/* packs the @n bytes at @s into the GUID_PACKED bytes at @out if they are a
+ * braced upper-case GUID
+ *
+ * returns whether they were
+ */
+static inline bool guid_pack(const char *s, size_t n, char *out) {
+    if (n != GUID_TEXT || s[0] != '{' || s[9] != '-' || s[14] != '-'
+            || s[19] != '-' || s[24] != '-' || s[37] != '}')
+        return false;
+    uint64_t a, d;
+    uint32_t b0, b1, c0, c1;
+    memcpy(&a, s+1, 8);
+    memcpy(&b0, s+10, 4);
+    memcpy(&b1, s+15, 4);
+    memcpy(&c0, s+20, 4);
+    memcpy(&c1, s+25, 4);
+    memcpy(&d, s+29, 8);
+    out[0] = '\0';
+    return guid_word(a, out+1)
+        && guid_word(b0 | (uint64_t)b1 << 32, out+5)
+        && guid_word(c0 | (uint64_t)c1 << 32, out+9)
+        && guid_word(d, out+13);
+}
+
+/* returns whether the stored ID @id is a packed GUID
+ */
+static inline bool guid_packed(const jstr &id) {
+    return id.n == GUID_PACKED && id.s[0] == '\0';
+}
+
+/* writes the GUID_TEXT bytes of the text of the packed GUID @p to @out
+ */
+static inline void guid_text(const char *p, char *out) {
+    static const char hex[] = "0123456789ABCDEF";
+    char *o = out;
+    *o++ = '{';
+    for (int k = 0; k < 16; ++k) {
+        if (k == 4 || k == 6 || k == 8 || k == 10)
+            *o++ = '-';
+        *o++ = hex[(unsigned char)p[k+1] >> 4];
+        *o++ = hex[p[k+1] & 15];
+    }
+    *o = '}';
+}
+
+/* a view of an ID together with its hash_id, which the ID tables key on; a
+ * GUID is also kept packed, and hashed in that form
+ */
+struct jkey {
+    jstr str; // the ID as read (or as stored by an ID table)
+    uint64_t hash;
+    bool guid; // whether packed holds the ID
+    char packed[GUID_PACKED];
+    jkey() : hash(hash_id("", 0)), guid(false) {}
+    jkey(const jstr &str) : str(str) {
+        guid = guid_pack(str.s, str.n, packed);
+        hash = guid ? hash_id(packed, GUID_PACKED) : hash_id(str.s, str.n);
+    }
+    // for an ID in the form an ID table stores it, whose hash is known
+    jkey(const jstr &str, uint64_t hash) : str(str), hash(hash) {
+        guid = guid_packed(str);
+        if (guid)
+            memcpy(packed, str.s, GUID_PACKED);
+    }
+
+    /* returns the form of the ID the ID tables store
+     */
+    jstr stored() const { return guid ? jstr(packed, GUID_PACKED) : str; }
+};
+
+/* the state of a scan through a mapped json file: the read position together
+ * with the bookkeeping the parsers need (brace and bracket levels, and whether
+ * the position lies inside a string)
+ */
+struct json_file {
+    const char *pos, *end; // next byte to read, and one past the last byte
+    uint_fast32_t braces, brackets; // tracks the brace and bracket levels
+    bool instring; // tracks whether inside a string or not
+    // the structural masks of the 64 bytes starting at blk [see json_scan.h]
+    const char *blk;
+    uint64_t quotes, levels;
+    void *map; // the mapping itself, and its length
+    size_t maplen;
+    json_stream *stream; // the decompressor, for a compressed file
+};
+
+/* a read position of a json file, with the bookkeeping that goes with it
+ */
+struct json_mark {
+    const char *pos;
+    uint_fast32_t braces, brackets;
+    bool instring;
+};
+
+/* maps the file @filename into memory (or starts decompressing it, if it is
+ * compressed) and prepares @file to scan it from the beginning
+ *
+ * returns true if the file could be mapped, or is compressed in a format this
+ * build reads
+ */
+bool json_open(json_file &file, const char *filename);
+
+/* prepares @file to scan the @len bytes at @data, which must outlive any view
+ * extracted from them
+ */
+void json_buffer(json_file &file, const char *data, size_t len);
+
+/* unmaps the file; any view extracted from it is invalidated
+ *
+ * returns false if the file turned out to be unreadable (a corrupt or
+ * truncated compressed file)
+ */
+bool json_close(json_file &file);
+
+/* drops the pages of the mapping of @file lying before the read position (or
+ * before @upto, if given) from memory; being unmodified, they are read back
+ * from the file should they be needed again (as the views of extract_string
+ * into them may be)
+ */
+void json_release(json_file &file, const char *upto = nullptr);
+
+/* makes sure the @n bytes from @p onwards (at or after the read position of
+ * @file) are in memory if the input has that many, waiting for the
+ * decompressor if need be
+ *
+ * returns whether they are
+ */
+static inline bool json_more(json_file &file, const char *p, size_t n);
+
+/* waits until the whole input of @file is in memory
+ */
+void json_load(json_file &file);
+
+/* returns the size of the input of @file still to be read, as far as can be
+ * told before it is read (a guess for a compressed file)
+ */
+size_t json_expected(const json_file &file);
+
+/* returns the read position of @file
+ */
+static inline json_mark json_tell(const json_file &file);
+
+/* moves the read position of @file back to @mark, noted by json_tell on the
+ * same file; the bytes from there on are read again as they were the first
+ * time (a compressed input keeps them, and the pages of a mapping released
+ * since are read back from the file)
+ */
+static inline void json_seek(json_file &file, const json_mark &mark);
+
+/* scans the json @file for the next string (enclosed by double quotes "...")
+ * and points @out at its contents inside the mapping
+ */
+void extract_string(json_file &file, jstr &out);
+
+/* as above, additionally hashing the string while its bytes are at hand
+ */
+void extract_string(json_file &file, jkey &out);
+
+
+// ==== DEFINITIONS ==== //
+
+bool json_open(json_file &file, const char *filename) {
+    file.pos = file.end = file.blk = nullptr;
+    file.braces = file.brackets = 0;
+    file.instring = false;
+    file.map = nullptr;
+    file.maplen = 0;
+    file.stream = nullptr;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+    json_stream *stream = new json_stream;
+    if (stream_open(*stream, fd)) {
+        // the decompressor reads the file from here on
+        file.stream = stream;
+        file.pos = file.end = stream->data;
+        return true;
+    }
+    delete stream;
+    if (stream_magic(fd) != STREAM_NONE) {
+        close(fd); // compressed in a format this build does not read
+        return false;
+    }
+    if (st.st_size > 0) {
+        void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        // the parsers only ever move forward, so let the kernel read ahead
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        file.map = map;
+        file.maplen = st.st_size;
+        file.pos = (const char *)map;
+        file.end = file.pos + st.st_size;
+    }
+    close(fd); // the mapping keeps its own reference to the file
+    return true;
+}
+
+void json_buffer(json_file &file, const char *data, size_t len) {
+    file.pos = data;
+    file.end = data + len;
+    file.blk = nullptr;
+    file.braces = file.brackets = 0;
+    file.instring = false;
+    file.map = nullptr; // nothing to unmap
+    file.maplen = 0;
+    file.stream = nullptr;
+}
+
+bool json_close(json_file &file) {
+    bool ok = true;
+    if (file.map)
+        munmap(file.map, file.maplen);
+    if (file.stream) {
+        ok = stream_close(*file.stream);
+        delete file.stream;
+    }
+    file.map = nullptr;
+    file.stream = nullptr;
+    file.pos = file.end = nullptr;
+    return ok;
+}
+
+void json_release(json_file &file, const char *upto) {
+    if (!file.map)
+        return;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t done = ((upto ? upto : file.pos) - (const char *)file.map)
+        / page * page;
+    if (done)
+        madvise(file.map, done, MADV_DONTNEED);
+}
+
+static inline bool json_more(json_file &file, const char *p, size_t n) {
+    if ((size_t)(file.end - p) >= n)
+        return true;
+    if (!file.stream)
+        return false;
+    const char *data = file.stream->data;
+    file.end = data + stream_wait(*file.stream, p - data + n);
+    return (size_t)(file.end - p) >= n;
+}
+
+void json_load(json_file &file) {
+    if (file.stream)
+        json_more(file, file.pos, file.stream->reserve);
+}
+
+size_t json_expected(const json_file &file) {
+    if (!file.stream)
+        return file.end - file.pos;
+    size_t read = file.pos - file.stream->data;
+    return file.stream->hint > read ? file.stream->hint - read : 0;
+}
+
+/* reads the next character of the json @file, while also tracking bookkeeping
+ * information (the braces, brackets and instring of @file). Reading past the
+ * end of the input returns '\0' without moving.
+ *
+ * returns the read character
+ */
+static inline char readc(json_file &file) {
+    if (file.pos == file.end && !json_more(file, file.pos, 1))
+        return '\0';
+    char c = *file.pos++;
+    if (c == '"') {
+        // entered or exited a string
+        file.instring = !file.instring;
+        return c;
+    }
+    if (file.instring)
+        return c; // character holds no other meaning if inside a string
+
+    switch (c) {
+        case '{':
+        ++file.braces; // entered a new field
+        break;
+        case '}':
+        --file.braces; // exited a field
+        break;
+        case '[':
+        ++file.brackets; // entered a new list
+        break;
+        case ']':
+        --file.brackets; // exited a list
+        break;
+        default: // otherwise it is an ordinary character, so do nothing
+        break;
+    }
+    return c;
+}
+
+/* returns true once the json @file has been read to the end
+ */
+static inline bool json_eof(json_file &file) {
+    return file.pos == file.end && !json_more(file, file.pos, 1);
+}
+
+static inline json_mark json_tell(const json_file &file) {
+    return json_mark{ file.pos, file.braces, file.brackets, file.instring };
+}
+
+static inline void json_seek(json_file &file, const json_mark &mark) {
+    file.pos = mark.pos;
+    file.braces = mark.braces;
+    file.brackets = mark.brackets;
+    file.instring = mark.instring;
+    file.blk = nullptr; // the masks are indexed again from there
+}
+
+/* makes sure the structural masks of the json @file cover its position,
+ * indexing the 64 bytes from there if they do not (the final bytes of the
+ * input are indexed through a zero-padded copy; a block is only cut short at
+ * the true end of a compressed input, never where its decompression is up to)
+ */
+static inline void index_block(json_file &file) {
+    if (file.blk && file.blk <= file.pos && file.pos < file.blk + 64)
+        return;
+    file.blk = file.pos;
+    if (json_more(file, file.pos, 64)) {
+        scanner.index(file.pos, file.quotes, file.levels);
+    } else {
+        char pad[64] = {};
+        memcpy(pad, file.pos, file.end - file.pos);
+        scanner.index(pad, file.quotes, file.levels);
+    }
+}
+
+/* reads through the next quote, brace or bracket of the json @file (only the
+ * closing quote if inside a string), skipping everything in between
+ *
+ * returns the read character, or '\0' if the input ran out
+ */
+static inline char next_token(json_file &file) {
+    while (!json_eof(file)) {
+        index_block(file);
+        uint64_t m = file.instring ? file.quotes : file.quotes | file.levels;
+        m &= ~0ULL << (file.pos - file.blk);
+        if (m) {
+            file.pos = file.blk + __builtin_ctzll(m);
+            return readc(file);
+        }
+        file.pos = file.end - file.blk > 64 ? file.blk + 64 : file.end;
+    }
+    return '\0';
+}
+
+/* reads through the next brace or bracket of the json @file lying outside of
+ * any string, skipping whole strings at a time
+ *
+ * returns the read character, or '\0' if the input ran out
+ */
+static inline char next_level(json_file &file) {
+    while (!json_eof(file)) {
+        index_block(file);
+        uint64_t live = ~0ULL << (file.pos - file.blk);
+        uint64_t q = file.quotes & live;
+        uint64_t in = prefix_xor(q) ^ (file.instring ? ~0ULL : 0);
+        uint64_t hit = file.levels & live & ~in;
+        if (hit) {
+            uint_fast32_t i = __builtin_ctzll(hit);
+            file.instring ^= __builtin_popcountll(q & ((1ULL << i) - 1)) & 1;
+            file.pos = file.blk + i;
+            return readc(file);
+        }
+        file.instring ^= __builtin_popcountll(q) & 1;
+        file.pos = file.end - file.blk > 64 ? file.blk + 64 : file.end;
+    }
+    return '\0';
+}
+
+void extract_string(json_file &file, jstr &out) {
+    while (!file.instring && next_token(file) != '\0')
+        ; // read to next string
+    if (!file.instring) {
+        out = jstr(); // ran out of input
+        return;
+    }
+    const char *start = file.pos;
+    next_token(file); // closing quote
+    out = jstr(start, file.pos - start - !file.instring);
+}
+
+void extract_string(json_file &file, jkey &out) {
+    jstr str;
+    extract_string(file, str);
+    out = jkey(str);
+}
+
+#endif
@@ -0,0 +1,151 @@
+/* JSON Structural Indexer
+ * author: Zach Goldthorpe
+ *
+ * The file provides the kernels that let the parsers jump between structural
+ * characters (quotes, braces and brackets) instead of stepping byte by byte.
+ * A kernel indexes 64 bytes at a time into bitmasks, which the reader then
+ * walks with bit tricks; each kernel exists in a scalar, an SSE4.2 and an AVX2
+ * flavour, and the best one supported by the running CPU is chosen at startup.
+ *
+ * Like the original byte-wise reader, backslash escapes are not interpreted: a
+ * quote always opens or closes a string.
+ *
+ * scanner:    the kernels in use
+ * prefix_xor: turn a mask of quotes into a mask of in-string bytes
+ */
+
+#ifndef _json_scan_h_
+#define _json_scan_h_
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define JSON_SCAN_X86
+#endif
+
+/* a structural indexer: index reads the 64 bytes at @p and sets bit i of
+ * @quotes (resp. @levels) if byte i is a double quote (resp. one of {}[])
+ */
+struct json_scanner {
+    const char *name;
+    void (*index)(const char *p, uint64_t &quotes, uint64_t &levels);
+};
+
+// the kernels chosen for this CPU
+extern json_scanner scanner;
+
+/* the individual implementations, for benchmarking; the vectorised ones are
+ * only usable when scanner_supported says so
+ */
+extern const json_scanner scanner_scalar, scanner_sse42, scanner_avx2;
+bool scanner_supported(const json_scanner &kernels);
+
+/* the bit at position i of the result is the parity of the bits of @q up to
+ * and including position i; applied to a quote mask, this marks the bytes
+ * inside strings (opening quote included, closing quote excluded)
+ */
+static inline uint64_t prefix_xor(uint64_t q);
+
+
+// ==== DEFINITIONS ==== //
+
+static inline uint64_t prefix_xor(uint64_t q) {
+    q ^= q << 1;
+    q ^= q << 2;
+    q ^= q << 4;
+    q ^= q << 8;
+    q ^= q << 16;
+    q ^= q << 32;
+    return q;
+}
+
+static void index_scalar(const char *p, uint64_t &quotes, uint64_t &levels) {
+    quotes = levels = 0;
+    for (int i = 0; i < 64; ++i) {
+        switch (p[i]) {
+            case '"':
+            quotes |= 1ULL << i;
+            break;
+            case '{': case '}': case '[': case ']':
+            levels |= 1ULL << i;
+            break;
+            default:
+            break;
+        }
+    }
+}
+
+#ifdef JSON_SCAN_X86
+
+__attribute__((target("sse4.2")))
+static void index_sse42(const char *p, uint64_t &quotes, uint64_t &levels) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i set = _mm_setr_epi8('{', '}', '[', ']',
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    quotes = levels = 0;
+    for (int i = 0; i < 4; ++i) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 16*i));
+        uint64_t q = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote));
+        uint64_t b = (uint32_t)_mm_cvtsi128_si32(_mm_cmpestrm(set, 4, v, 16,
+            _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK));
+        quotes |= q << (16*i);
+        levels |= b << (16*i);
+    }
+}
+
+/* setting bit 5 folds '[' onto '{' and ']' onto '}', and nothing else lands on
+ * either, so two comparisons find all four characters
+ */
+__attribute__((target("avx2")))
+static void index_avx2(const char *p, uint64_t &quotes, uint64_t &levels) {
+    const __m256i quote = _mm256_set1_epi8('"'), fold = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{'), close = _mm256_set1_epi8('}');
+    __m256i lo = _mm256_loadu_si256((const __m256i *)p);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)(p + 32));
+    __m256i flo = _mm256_or_si256(lo, fold), fhi = _mm256_or_si256(hi, fold);
+    quotes = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, quote))
+        | (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, quote))
+        << 32;
+    levels = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(flo, open), _mm256_cmpeq_epi8(flo, close)))
+        | (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(fhi, open), _mm256_cmpeq_epi8(fhi, close)))
+        << 32;
+}
+
+const json_scanner scanner_sse42 = { "sse4.2", index_sse42 };
+const json_scanner scanner_avx2 = { "avx2", index_avx2 };
+
+#else
+
+// without x86 vector extensions, both fall back to the scalar kernel
+const json_scanner scanner_sse42 = { "sse4.2", index_scalar };
+const json_scanner scanner_avx2 = { "avx2", index_scalar };
+
+#endif
+
+const json_scanner scanner_scalar = { "scalar", index_scalar };
+
+bool scanner_supported(const json_scanner &kernels) {
+    #ifdef JSON_SCAN_X86
+    __builtin_cpu_init();
+    if (&kernels == &scanner_avx2)
+        return __builtin_cpu_supports("avx2");
+    if (&kernels == &scanner_sse42)
+        return __builtin_cpu_supports("sse4.2");
+    #endif
+    return &kernels == &scanner_scalar;
+}
+
+/* picks the widest kernels this CPU supports
+ */
+static json_scanner select_scanner() {
+    if (scanner_supported(scanner_avx2))
+        return scanner_avx2;
+    if (scanner_supported(scanner_sse42))
+        return scanner_sse42;
+    return scanner_scalar;
+}
+
+json_scanner scanner = select_scanner();
+
+#endif
@@ -0,0 +1,277 @@
+/* Compressed JSON Input
+ * author: Zach Goldthorpe
+ *
+ * The file provides the decompressing input behind json_open for exports
+ * stored as gzip (.json.gz, built with -D JSON_GZIP and -lz) or zstd
+ * (.json.zst, built with -D JSON_ZSTD and -lzstd), told apart by their magic
+ * bytes rather than their names. No temporary file is written.
+ *
+ * The parsers scan their input in place and keep views into it [see
+ * json_file.h], so the decompressed JSON has to lie in one piece that never
+ * moves. It is therefore decompressed into an anonymous mapping reserved up
+ * front (without committing memory to it) by a thread of its own, one block
+ * at a time, while the parser reads the blocks already done: the parser only
+ * waits when it catches up with the decompressor, and the decompressor never
+ * waits for the parser.
+ *
+ * The reservation is 128 times the compressed size (and at least 1 GiB), far
+ * beyond what JSON compresses to; an export decompressing to more than that is
+ * refused, as is a corrupt or truncated one.
+ *
+ * stream_magic: tell the compression format of a file
+ * stream_open:  start decompressing a file
+ * stream_wait:  wait until enough of it is decompressed
+ * stream_close: stop decompressing and release the data
+ */
+
+#ifndef _json_stream_h_
+#define _json_stream_h_
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef JSON_GZIP
+    #include <zlib.h>
+#endif
+#ifdef JSON_ZSTD
+    #include <zstd.h>
+#endif
+
+// the bytes the decompressor reads and writes at a time
+#define STREAM_BLOCK (1 << 20)
+
+enum stream_kind { STREAM_NONE, STREAM_GZIP, STREAM_ZSTD };
+
+struct json_stream {
+    char *data = nullptr; // the decompressed bytes, and the space reserved
+    size_t reserve = 0;
+    // the number of bytes decompressed so far (published once written), and
+    // whether there will be no more
+    std::atomic<size_t> avail{0};
+    std::atomic<bool> done{false};
+    std::atomic<bool> stop{false}; // asks the decompressor to stop early
+    bool failed = false; // whether the input was corrupt (set before done)
+    size_t hint = 0; // the expected decompressed size, to presize tables
+    int fd = -1;
+    std::mutex lock;
+    std::condition_variable more;
+    std::thread worker;
+};
+
+/* returns the format the file open on @fd is compressed in, whether or not
+ * this build reads it (STREAM_NONE if it is not compressed)
+ */
+stream_kind stream_magic(int fd);
+
+/* starts decompressing the file open on @fd into @s if it is compressed in a
+ * format this build reads, taking over @fd
+ *
+ * returns false (leaving @fd open) if it is not
+ */
+bool stream_open(json_stream &s, int fd);
+
+/* waits until at least @want bytes are decompressed, or there are no more
+ *
+ * returns the number of bytes decompressed
+ */
+static inline size_t stream_wait(json_stream &s, size_t want);
+
+/* stops the decompressor and releases the data of @s
+ *
+ * returns false if the input turned out to be corrupt or too large
+ */
+bool stream_close(json_stream &s);
+
+
+// ==== DEFINITIONS ==== //
+
+/* publishes the first @n bytes of @s as decompressed, and wakes the parser
+ */
+static inline void stream_publish(json_stream &s, size_t n, bool last = false) {
+    std::lock_guard<std::mutex> hold(s.lock);
+    s.avail.store(n, std::memory_order_release);
+    if (last)
+        s.done.store(true, std::memory_order_release);
+    s.more.notify_all();
+}
+
+/* reads up to @cap bytes of @fd into @buf
+ *
+ * returns the number read, 0 at the end of the file, or -1 on an error
+ */
+static inline ssize_t stream_read(int fd, char *buf, size_t cap) {
+    for (;;) {
+        ssize_t k = read(fd, buf, cap);
+        if (k >= 0 || errno != EINTR)
+            return k;
+    }
+}
+
+#ifdef JSON_GZIP
+/* decompresses the gzip members of @s.fd, one after the other
+ */
+static void stream_gzip(json_stream &s) {
+    std::vector<char> in(STREAM_BLOCK);
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    bool ok = inflateInit2(&z, 15 + 16) == Z_OK, member = false;
+    size_t out = 0;
+    while (ok && !s.stop.load(std::memory_order_relaxed)) {
+        if (!z.avail_in) {
+            ssize_t k = stream_read(s.fd, in.data(), in.size());
+            if (k <= 0) {
+                ok = k == 0 && !member; // ends between two members
+                break;
+            }
+            z.next_in = (Bytef *)in.data();
+            z.avail_in = k;
+        }
+        size_t room = std::min<size_t>(STREAM_BLOCK, s.reserve - out);
+        if (!room) {
+            ok = false; // larger than the reservation
+            break;
+        }
+        z.next_out = (Bytef *)s.data + out;
+        z.avail_out = room;
+        member = true;
+        int r = inflate(&z, Z_NO_FLUSH);
+        out += room - z.avail_out;
+        if (r == Z_STREAM_END) {
+            // another member may follow (as pigz and cat write)
+            member = false;
+            ok = inflateReset(&z) == Z_OK;
+        } else if (r != Z_OK && r != Z_BUF_ERROR) {
+            ok = false;
+        }
+        stream_publish(s, out);
+    }
+    inflateEnd(&z);
+    s.failed = !ok && !s.stop.load(std::memory_order_relaxed);
+    stream_publish(s, out, true);
+}
+#endif
+
+#ifdef JSON_ZSTD
+/* decompresses the zstd frames of @s.fd, one after the other
+ */
+static void stream_zstd(json_stream &s) {
+    std::vector<char> in(ZSTD_DStreamInSize());
+    ZSTD_DStream *z = ZSTD_createDStream();
+    bool ok = z && !ZSTD_isError(ZSTD_initDStream(z));
+    ZSTD_inBuffer src = { in.data(), 0, 0 };
+    size_t out = 0, left = 0; // left is nonzero inside a frame
+    while (ok && !s.stop.load(std::memory_order_relaxed)) {
+        if (src.pos == src.size) {
+            ssize_t k = stream_read(s.fd, in.data(), in.size());
+            if (k <= 0) {
+                ok = k == 0 && !left;
+                break;
+            }
+            src.size = k;
+            src.pos = 0;
+        }
+        size_t room = std::min<size_t>(STREAM_BLOCK, s.reserve - out);
+        if (!room) {
+            ok = false;
+            break;
+        }
+        ZSTD_outBuffer dst = { s.data + out, room, 0 };
+        left = ZSTD_decompressStream(z, &dst, &src);
+        ok = !ZSTD_isError(left);
+        out += dst.pos;
+        stream_publish(s, out);
+    }
+    ZSTD_freeDStream(z);
+    s.failed = !ok && !s.stop.load(std::memory_order_relaxed);
+    stream_publish(s, out, true);
+}
+#endif
+
+stream_kind stream_magic(int fd) {
+    unsigned char magic[4] = {};
+    if (pread(fd, magic, 4, 0) != 4)
+        return STREAM_NONE;
+    if (magic[0] == 0x1F && magic[1] == 0x8B)
+        return STREAM_GZIP;
+    if (magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F
+            && magic[3] == 0xFD)
+        return STREAM_ZSTD;
+    return STREAM_NONE;
+}
+
+bool stream_open(json_stream &s, int fd) {
+    stream_kind kind = stream_magic(fd);
+    struct stat st;
+    if (kind == STREAM_NONE || fstat(fd, &st) < 0)
+        return false;
+    size_t packed = st.st_size;
+    void (*decompress)(json_stream &) = nullptr;
+    s.hint = packed * 8; // a typical ratio for JSON, unless the file says
+    #ifdef JSON_GZIP
+    if (kind == STREAM_GZIP) {
+        decompress = stream_gzip;
+        // the trailer holds the size modulo 2^32 (of the last member)
+        uint32_t size;
+        if (pread(fd, &size, 4, packed - 4) == 4 && size >= packed)
+            s.hint = size;
+    }
+    #endif
+    #ifdef JSON_ZSTD
+    if (kind == STREAM_ZSTD) {
+        decompress = stream_zstd;
+        char head[18]; // the largest frame header
+        ssize_t k = pread(fd, head, sizeof(head), 0);
+        unsigned long long size = k > 0
+            ? ZSTD_getFrameContentSize(head, k) : ZSTD_CONTENTSIZE_UNKNOWN;
+        if (size != ZSTD_CONTENTSIZE_UNKNOWN && size != ZSTD_CONTENTSIZE_ERROR)
+            s.hint = size;
+    }
+    #endif
+    if (!decompress)
+        return false;
+    s.reserve = std::max<size_t>(std::max<size_t>(packed * 128, s.hint),
+        (size_t)1 << 30);
+    void *map = mmap(nullptr, s.reserve, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED)
+        return false;
+    s.data = (char *)map;
+    s.fd = fd;
+    s.worker = std::thread(decompress, std::ref(s));
+    return true;
+}
+
+static inline size_t stream_wait(json_stream &s, size_t want) {
+    size_t n = s.avail.load(std::memory_order_acquire);
+    if (n >= want || s.done.load(std::memory_order_acquire))
+        return s.avail.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> hold(s.lock);
+    s.more.wait(hold, [&]() {
+        return s.avail.load(std::memory_order_acquire) >= want
+            || s.done.load(std::memory_order_acquire);
+    });
+    return s.avail.load(std::memory_order_acquire);
+}
+
+bool stream_close(json_stream &s) {
+    s.stop.store(true, std::memory_order_relaxed);
+    if (s.worker.joinable())
+        s.worker.join();
+    if (s.fd >= 0)
+        close(s.fd);
+    if (s.data)
+        munmap(s.data, s.reserve);
+    s.data = nullptr;
+    s.fd = -1;
+    return !s.failed;
+}
+
+#endif
@@ -0,0 +1,218 @@
+/* NETWORK
+ * author: Zach Goldthorpe
+ *
+ * The file provides the types holding a network and the starting points of a
+ * query laid over it [see read_graph.h for how they are built]. Everything
+ * known about one network lives in its network object, so that several
+ * networks may be held in one process, and any number of queries may read the
+ * same network at once, each through its own overlay.
+ *
+ * A network is built once (by read_graph or load_snapshot) and is only read
+ * from then on, except for the index, which may be built or edited, and the
+ * graph, which may be contracted, before the queries start [see bc_index.h,
+ * bc_edit.h, contract.h].
+ */
+
+#ifndef _network_h_
+#define _network_h_
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/mman.h>
+#include "flat.h"
+#include "id_table.h"
+#include "stats.h"
+
+// ==== reduction 2 defines ==== //
+#define HEAD 0 // underlying main starting point
+#define TAIL 1 // underlying main controller
+#define REAL(v) (v > TAIL) // marks if the vertex is part of the original graph
+
+using uintf = uint_fast32_t;
+using uintp = std::pair<uintf, uintf>;
+
+/* an arc of the graph: the neighbour it leads to and the edge it belongs to
+ */
+struct arc {
+    uint32_t to, edge;
+};
+
+/* the graph in compressed sparse row form: the arcs leaving vertex v are
+ * arcs[first[v]] up to (but excluding) arcs[first[v+1]], in the order in
+ * which the rows and the reductions introduced them
+ */
+struct csr {
+    flat<uint32_t> first;
+    flat<arc> arcs;
+};
+
+/* a link of the graph under construction: the edge @e joining @u and @v
+ */
+struct graph_link {
+    uint32_t u, v, e;
+};
+
+/* the block-cut forest: nodes 0..vertices-1 are the vertices of the subdivided
+ * network (the vertices of the graph, of which there are real, then one per
+ * <u, v> pair), and the remaining nodes are the blocks [see bc_index.h]
+ */
+struct bc_forest {
+    uint32_t real = 0, vertices = 0;
+    // parent[x] is the parent of node x (NOPARENT for a root), depth[x] its
+    // distance from the root and comp[x] the root itself; once the index is
+    // edited, depth[x] is only guaranteed to exceed the depth of the parent,
+    // and comp[x] to be shared by the whole tree
+    flat<uint32_t> parent, depth, comp;
+    // the children of block b are blockvtx[blockfirst[b]..blockfirst[b+1]),
+    // counting b from the first block node
+    flat<uint32_t> blockfirst, blockvtx;
+
+    // once the index is edited [see bc_edit.h], block[x] indicates that node x
+    // is a block, and children[x] replaces the children of the nodes the
+    // edits have touched; nodes made by the edits are numbered after all
+    // others, with the vertices of the graph and edges they stand for kept in
+    // nodevertex and pairedge (and the other way round in vertexnode and
+    // edgepairs)
+    std::vector<bool> block;
+    std::unordered_map<uint32_t, std::vector<uint32_t> > children;
+    std::unordered_map<uint32_t, uint32_t> nodevertex, vertexnode, pairedge;
+    std::unordered_map<uint32_t, std::vector<uint32_t> > edgepairs;
+    // the vertices of the base network left without rows by the edits, and
+    // the vertices of its pairs the edits have removed
+    std::unordered_set<uint32_t> removed;
+
+    // while editing, the neighbours of vertex x of the subdivided network are
+    // edit_arcs[edit_first[x]..edit_first[x+1]) (for the vertices of the base
+    // network, skipping the pairs since removed) followed by edit_more[x]
+    std::vector<uint32_t> edit_first, edit_arcs;
+    std::unordered_map<uint32_t, std::vector<uint32_t> > edit_more;
+    // the child blocks of vertex x of the base network, until x is edited,
+    // are edit_blocks[edit_vfirst[x]..edit_vfirst[x+1])
+    std::vector<uint32_t> edit_vfirst, edit_blocks;
+    // the number of nodes in the index before the edits
+    uint32_t edit_base = 0;
+    // the number of vertices in each tree, by its comp
+    std::unordered_map<uint32_t, uint32_t> edit_size;
+    // scratch space marking vertices with their position in a list (NOPARENT
+    // for the others)
+    std::vector<uint32_t> edit_mark;
+};
+
+/* the contraction of a graph [see contract.h]: the trees hanging off it are
+ * pruned, and each chain of vertices of degree 2 is collapsed into a single
+ * edge, numbered after the dummy edge (chain k being edge edges+1+k)
+ */
+struct contraction {
+    bool built = false;
+    // anchor[v] is v itself if vertex v was kept, and otherwise the kept
+    // vertex its tree hangs from (NOANCHOR if the whole tree was pruned), with
+    // hang[v] the arc leading from v towards it
+    std::vector<uint32_t> anchor;
+    std::vector<arc> hang;
+    // chain[v] is the chain vertex v was collapsed into (NOCHAIN if it was
+    // not), and at[v] its position along the chain, counting from 1
+    std::vector<uint32_t> chain, at;
+    // chain k runs from ends[k].first to ends[k].second through the members
+    // members[memberfirst[k]..memberfirst[k+1]), each being the arc leading
+    // to the next vertex (the last one to ends[k].second)
+    std::vector<std::pair<uint32_t, uint32_t> > ends;
+    std::vector<uint32_t> memberfirst;
+    std::vector<arc> members;
+};
+
+/* the base network: the rows and the controllers (attached to TAIL), with
+ * vertices 0 and 1 being HEAD and TAIL, then the junctions of the JSON, then
+ * the vertices reduction 1 made from the controller edges
+ */
+struct network {
+    csr graph;
+    uintf nodes = 0; // the number of vertices
+    // the number of edges read; the edge of this index is the dummy edge used
+    // by the reductions
+    uintf edges = 0;
+    // edgenodes stores all <u, v> pairs edge e represents, which are
+    // edgenodes[i] for edgefirst[e] <= i < edgefirst[e+1]
+    flat<uint32_t> edgefirst;
+    flat<std::pair<uint32_t, uint32_t> > edgenodes;
+    // idx, edgeidx map the names of the vertices and edges to their indices
+    // (and back); vertex v is stored as index v-2, after HEAD and TAIL
+    id_table idx, edgeidx;
+    // edgevtx[e] stores the first of the vertices the edge e broke down into
+    // (by reduction 1) as a controller, one per <u, v> pair and numbered
+    // consecutively, or UNSPLIT; these are the controller flags of the edges
+    flat<uint32_t> edgevtx;
+    // splitedge[i] stores the edge the i-th vertex made by reduction 1 came
+    // from
+    flat<uint32_t> splitedge;
+    // the block-cut tree index (empty unless built), whether the queries go
+    // through it, and the vertices of the index standing for the controllers
+    // it answers for
+    bc_forest index;
+    bool indexed = false;
+    std::vector<uint32_t> ctrls;
+    // the ID's listed as controllers by the JSON, whether or not the rows
+    // name them (an edit may add them later), back to back as text: ID i is
+    // ctrlnames[ctrlfirst[i]..ctrlfirst[i+1])
+    flat<char> ctrlnames;
+    flat<uint64_t> ctrlfirst;
+    // links stores every link of the graph until it is laid out as a csr
+    std::vector<graph_link> links;
+    // the trees and chains contracted out of the graph, if it was contracted
+    contraction contracted;
+    // the JSON the network was read from, which low-memory mode reads again
+    // for the names, and the statistics of building it [see stats.h]
+    std::string source;
+    run_stats stats;
+    // the snapshot the arrays are mapped from, if any
+    void *mapping = nullptr;
+    size_t maplen = 0;
+
+    network() = default;
+    network(const network &) = delete;
+    network &operator=(const network &) = delete;
+    ~network() {
+        if (mapping)
+            munmap(mapping, maplen);
+    }
+};
+
+/* the part of chain @chain of a contracted network between the vertices at
+ * positions @from and @to, left as an edge of an overlay
+ */
+struct chain_piece {
+    uint32_t chain, from, to;
+};
+
+/* the starting points of one query, laid over a network @net without
+ * changing it: the vertices reduction 1 makes from starting point edges follow
+ * those of the network, and every vertex the starting points touch gets its
+ * complete adjacency here, replacing the one of the network
+ */
+struct overlay {
+    const network *net = nullptr;
+    uintf nodes = 0; // the number of vertices, including the base network
+    // split[i] stores the edge vertex nodes+i was made from by reduction 1,
+    // and edgevtx maps such an edge to the first of its vertices
+    std::vector<uint32_t> split;
+    std::unordered_map<uint32_t, uint32_t> edgevtx;
+    // the arcs of vertex v are arcs[range[v].first..range[v].second) if
+    // touched[v] is set
+    std::vector<bool> touched;
+    std::unordered_map<uint32_t, std::pair<uint32_t, uint32_t> > range;
+    std::vector<arc> arcs;
+    std::vector<graph_link> links; // the links, until laid out
+    // on a contracted network, the edges of the chains cut open by the
+    // starting points, and the pieces of those chains left joining the
+    // vertices they cut them at (piece i being edge edges+1+chains+i); the
+    // starting points lying in pruned trees hang from the vertex hung[j].first
+    // by the features hungfeats[hung[j-1].second..hung[j].second)
+    std::unordered_set<uint32_t> cut;
+    std::vector<chain_piece> pieces;
+    std::vector<std::pair<uint32_t, uint32_t> > hung;
+    std::vector<uint32_t> hungfeats;
+};
+
+#endif
@@ -0,0 +1,221 @@
+/* OUTPUT WRITER
+ * author: Zach Goldthorpe
+ *
+ * The file provides the stage writing the upstream features of a query. The
+ * sweeps finding them meet a feature once for every vertex sharing its name
+ * (the vertices reduction 1 makes from an edge) and an edge from both of its
+ * ends, so the writer keeps a bitmap of the features [see read_graph.h] it has
+ * already written and drops the repeats: every feature is written exactly once.
+ *
+ * The names are gathered in a large buffer that is handed to write() whenever
+ * it fills up, instead of going through a stream one name at a time. In sorted
+ * mode the features are instead collected and written in byte order of their
+ * names once the query is complete, as "sort -u" would leave them. In deferred
+ * mode the features are only collected, and the caller writes their names
+ * itself with out_text once it has found them. In low-memory mode, where the
+ * network has no names to give, out_names finds them in the JSON once the
+ * query is complete.
+ *
+ * out_begin:   start writing the features of a query to a descriptor
+ * out_feature: write a feature, unless it was already written
+ * out_text:    write a name (in deferred mode)
+ * out_names:   find the names of the features (in low-memory mode)
+ * out_end:     write what remains of the query
+ */
+
+#ifndef _output_h_
+#define _output_h_
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include "read_graph.h"
+
+// the size of the buffer handed to write()
+#define OUT_BUFFER (1 << 20)
+
+struct feature_out {
+    const network *net = nullptr; // the network the features are of
+    int fd = -1;
+    // if set, the names are appended here instead of being written to fd
+    std::vector<std::string> *names = nullptr;
+    bool sorted = false; // whether to write the features sorted by name
+    // whether to only collect the features, leaving their names to out_text
+    bool deferred = false;
+    bool ok = true; // whether every write so far went through
+    // seen has a bit for every feature, set once it is written, and written
+    // lists the features set, to clear them for the next query
+    std::vector<uint64_t> seen;
+    std::vector<uint32_t> written;
+    std::vector<char> buf;
+    // in low-memory mode, the name of feature f found by out_names lies in
+    // named_arena at named_at[f] (with a length of 0 for the others)
+    std::vector<uint64_t> named_at;
+    std::vector<uint32_t> named_len;
+    std::vector<char> named_arena;
+};
+
+/* writes all @n bytes at @p to the descriptor @fd
+ *
+ * returns false if the descriptor stopped accepting them
+ */
+static bool write_all(int fd, const char *p, size_t n);
+
+/* starts writing the features of a new query on the network @net to the
+ * descriptor @fd (or to @out.names) through @out, forgetting those of the
+ * previous query
+ */
+void out_begin(feature_out &out, const network &net, int fd);
+
+/* writes the feature @f (or nothing for NOFEATURE) through @out, unless it
+ * was already written for this query
+ */
+static inline void out_feature(feature_out &out, uint32_t f);
+
+/* writes the name @name through @out, on a line of its own
+ */
+static inline void out_text(feature_out &out, const jstr &name);
+
+/* in low-memory mode, finds the names of the features collected by @out in
+ * the JSON the network was read from, writing them as they are found unless
+ * they are to be sorted
+ *
+ * returns false if the JSON could not be read
+ */
+bool out_names(feature_out &out);
+
+/* writes the features of the query still held by @out, followed by an empty
+ * line if @blank is set
+ *
+ * returns false if any of the features could not be written
+ */
+bool out_end(feature_out &out, bool blank = false);
+
+
+// ==== DEFINITIONS ==== //
+
+static bool write_all(int fd, const char *p, size_t n) {
+    while (n) {
+        ssize_t k = write(fd, p, n);
+        if (k < 0 && errno == EINTR)
+            continue;
+        if (k <= 0)
+            return false;
+        p += k;
+        n -= k;
+    }
+    return true;
+}
+
+static inline void out_text(feature_out &out, const jstr &name) {
+    if (!name.n)
+        return;
+    if (out.names) {
+        out.names->emplace_back(name.s, name.n);
+        return;
+    }
+    if (out.buf.size() + name.n + 1 > OUT_BUFFER && !out.buf.empty()) {
+        out.ok = out.ok && write_all(out.fd, out.buf.data(), out.buf.size());
+        out.buf.clear();
+    }
+    out.buf.insert(out.buf.end(), name.s, name.s + name.n);
+    out.buf.push_back('\n');
+}
+
+/* these return the name of the feature @f as feature_name (resp. feature_key)
+ * would, or as out_names found it in low-memory mode
+ */
+static inline jstr out_found(const feature_out &out, uint32_t f) {
+    return f < out.named_len.size()
+        ? jstr(out.named_arena.data() + out.named_at[f], out.named_len[f])
+        : jstr();
+}
+static inline jstr out_fname(const feature_out &out, uint32_t f, char *buf) {
+    return out.net->idx.fingerprint ? out_found(out, f)
+        : feature_name(*out.net, f, buf);
+}
+static inline jstr out_key(const feature_out &out, uint32_t f) {
+    return out.net->idx.fingerprint ? out_found(out, f)
+        : feature_key(*out.net, f);
+}
+
+/* appends the name of the feature @f to the buffer of @out, flushing it first
+ * if it is full
+ */
+static inline void out_name(feature_out &out, uint32_t f) {
+    char buf[GUID_TEXT];
+    out_text(out, out_fname(out, f, buf));
+}
+
+void out_begin(feature_out &out, const network &net, int fd) {
+    out.net = &net;
+    for (uint32_t f : out.written)
+        out.seen[f >> 6] = 0;
+    out.written.clear();
+    // features may have been added by edits since the last query
+    out.seen.resize((features(net) + 63) >> 6, 0);
+    out.named_len.clear();
+    out.buf.clear();
+    out.buf.reserve(OUT_BUFFER);
+    out.fd = fd;
+    out.ok = true;
+}
+
+static inline void out_feature(feature_out &out, uint32_t f) {
+    if (f == NOFEATURE || (out.seen[f >> 6] >> (f & 63) & 1))
+        return;
+    out.seen[f >> 6] |= uint64_t(1) << (f & 63);
+    out.written.push_back(f);
+    if (!out.sorted && !out.deferred)
+        out_name(out, f);
+}
+
+bool out_names(feature_out &out) {
+    if (!out.sorted) {
+        return find_names(*out.net, out.written,
+            [&out](uint32_t, const jstr &name) {
+                out_text(out, name);
+            });
+    }
+    out.named_at.assign(features(*out.net), 0);
+    out.named_len.assign(features(*out.net), 0);
+    out.named_arena.clear();
+    return find_names(*out.net, out.written,
+        [&out](uint32_t f, const jstr &name) {
+            out.named_at[f] = out.named_arena.size();
+            out.named_len[f] = name.n;
+            out.named_arena.insert(out.named_arena.end(), name.s,
+                name.s + name.n);
+        });
+}
+
+bool out_end(feature_out &out, bool blank) {
+    if (out.sorted) {
+        std::vector<uint32_t> order = out.written;
+        std::sort(order.begin(), order.end(), [&out](uint32_t a, uint32_t b) {
+            // two packed GUID's compare as they are, otherwise as text
+            char bx[GUID_TEXT], by[GUID_TEXT];
+            jstr x = out_key(out, a), y = out_key(out, b);
+            if (guid_packed(x) != guid_packed(y)) {
+                x = out_fname(out, a, bx);
+                y = out_fname(out, b, by);
+            }
+            int c = memcmp(x.s, y.s, std::min(x.n, y.n));
+            return c ? c < 0 : x.n < y.n;
+        });
+        for (uint32_t f : order)
+            out_name(out, f);
+    }
+    if (out.names)
+        return true;
+    if (blank)
+        out.buf.push_back('\n');
+    out.ok = out.ok && write_all(out.fd, out.buf.data(), out.buf.size());
+    out.buf.clear();
+    return out.ok;
+}
+
+#endif
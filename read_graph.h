@@ -4,6 +4,29 @@
  * The file provides the method for either quickly or robustly taking the input
  * and constructing the graph, performing the two reductions specified in the
  * main file.
+ *
+ * The keys of the JSON may come in any order. The rows are read by the fast
+ * reader [see json_fast.h], which expects the keys of each row in the order
+ * the GIS Cup gives them; should a row break that order, the rows are read
+ * from that row onwards by the key-order-independent reader [see json.h]
+ * instead, so that only an export that needs it pays for it. Built with
+ * ROBUST, the key-order-independent reader reads all of them.
+ *
+ * The "rows" list may additionally be parsed by several threads at once: it is
+ * cut into chunks at row boundaries, each chunk is parsed into its own local ID
+ * tables, and the chunks are then merged in order so that every vertex and
+ * edge receives exactly the index the serial reader would have given it.
+ * Alternatively, the rows may be read on one thread and added to the graph on
+ * another, in the order they were read, so that scanning the JSON and probing
+ * the ID tables overlap.
+ *
+ * The network is built in two layers [see network.h]. The base network holds
+ * the rows and the controllers (attached to TAIL), and never changes once
+ * built, so it can also be saved to and loaded from a snapshot [see
+ * snapshot.h]. The starting points (attached to HEAD) only go into an overlay
+ * on top of it: the overlay holds the vertices that reduction 1 makes from
+ * starting point edges, and the complete adjacency of every vertex it touches,
+ * which replaces the base adjacency.
  */
 
 #ifndef read_graph_h
@@ -14,303 +37,951 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <thread>
+#include <array>
 #include <unordered_map>
+#include "flat.h"
+#include "id_table.h"
+#include "network.h"
+#include "stats.h"
+#include "spsc.h"
 
-#ifdef ROBUST
-    #include "json.h"
-#else
+#include "json.h"
+#ifndef ROBUST
     #include "json_fast.h"
 #endif
 
-// ==== reduction 2 defines ==== //
-#define HEAD 0 // underlying main starting point
-#define TAIL 1 // underlying main controller
-#define REAL(v) (v > TAIL) // marks if the vertex is part of the original graph
-
-using uintf = uint_fast32_t;
-using uintp = std::pair<uintf, uintf>;
-
-extern std::vector<std::vector<uintp> > graph;
-extern std::vector<std::string> name, edgename;
-extern std::vector<bool> badedge;
-extern uintf nodes;
-
-/* reads the JSON file provided by the @filename and populates @graph with the
- * graph it encodes. As specified by the GIS Cup, the JSON file should contain
- * the key "rows" which maps to a list of edge encodings, which are fields
- * namely storing the keys "viaGlobalId", "fromGlobalId", "toGlobalId"
- * specifying the edge name, and the vertices involved in the edge respectively.
+/* reads the JSON file provided by the @filename and builds the base network it
+ * encodes into @net, which must be new. As specified by the GIS Cup, the JSON
+ * file should contain the key "rows" which maps to a list of edge encodings,
+ * which are fields namely storing the keys "viaGlobalId", "fromGlobalId",
+ * "toGlobalId" specifying the edge name, and the vertices involved in the edge
+ * respectively.
  * The JSON file should additionally contain the key "controllers" which maps to
  * a list of fields namely storing the key "globalId" identifying the features
  * that are controllers. All other keys are ignored.
  *
- * after the construction of the graph, it reads the @startingpoints text file
- * for the keys and adjusts the graph according to the two reduction steps.
+ * the "rows" list is parsed by @threads threads (serially if @threads is 1),
+ * or, with @pipeline set, read on one thread while a second adds the rows to
+ * the graph; the resulting graph does not depend on either.
+ *
+ * with @low_memory set, the ID tables keep fingerprints instead of the names
+ * [see id_table.h] and the parsed part of the JSON is released as the rows
+ * are read, so the names of the features written have to be found again with
+ * find_names.
+ *
+ * the controllers are attached to TAIL according to the two reduction steps,
+ * and their ID's are kept as listed (even those the rows do not name) for
+ * the index [see bc_index.h]. Until then the graph is kept as a list of
+ * links, which is only laid out as the graph of @net at the very end.
+ *
+ * the file may also be compressed with gzip or zstd, if the program is built
+ * to read them [see json_stream.h]; it is then parsed as it is decompressed.
+ *
+ * returns false if the JSON file could not be read, or is malformed (holds no
+ * object, or ends inside one)
+ */
+bool read_graph(network &net, const char *filename, uintf threads = 1,
+    bool low_memory = false, bool pipeline = false);
+
+/* as above, reading the JSON from the @len bytes at @data instead (which need
+ * not outlive the network), without the low-memory mode
+ */
+bool parse_graph(network &net, const char *data, size_t len,
+    uintf threads = 1, bool pipeline = false);
+
+/* as above, reading the network from the JSON files @filenames instead, each
+ * holding some of its rows and controllers (an ID found in several of them
+ * naming the same feature): each file is parsed on a thread of its own, and
+ * their rows are then merged in order, so the network is the one read_graph
+ * would build from a single file listing the rows and the controllers of all
+ * of them in order
+ *
+ * returns false if one of the files could not be read or is malformed
+ */
+bool read_shards(network &net, const std::vector<std::string> &filenames);
+
+/* in low-memory mode, reads the "rows" of the JSON file @net was read from
+ * once more to find the names of the features @wanted, calling the
+ * function-type @action with each of them and its name, once, in the order
+ * the rows first name them
+ *
+ * returns false if the JSON file could not be read
+ */
+template<typename FUNC>
+bool find_names(const network &net, const std::vector<uint32_t> &wanted,
+    const FUNC &action);
+
+/* attaches the starting points named by @ids to HEAD according to the two
+ * reduction steps, in the overlay @ov on top of its network @ov.net (which
+ * must have been read or loaded already); whatever @ov held before is
+ * discarded. The network is only read, so several overlays may be set at
+ * once.
+ */
+void set_startingpoints(overlay &ov, const std::vector<std::string> &ids);
+
+/* as above, reading the keys from the lines of the @startingpoints text file
+ */
+void read_startingpoints(overlay &ov, const char *startingpoints);
+
+/* appends the lines of the text file @filename to @ids
+ *
+ * returns false if the file could not be read
+ */
+bool read_ids(const char *filename, std::vector<std::string> &ids);
+
+/* points @begin and @end at the arcs leaving vertex @v, taking the overlay @ov
+ * into account
+ */
+static inline void neighbours(const overlay &ov, uintf v, const arc *&begin,
+        const arc *&end);
+
+/* these return the original name of the vertex @v (resp. edge @e) provided by
+ * the JSON, written to the GUID_TEXT bytes at @buf if it is a packed GUID;
+ * HEAD, TAIL and the dummy edge have empty names, and the vertices made from
+ * an edge by reduction 1 (in the base network or the overlay @ov) share the
+ * name of that edge
+ */
+jstr vertex_name(const overlay &ov, uintf v, char *buf);
+jstr edge_name(const network &net, uintf e, char *buf);
+
+/* these return the feature of the vertex @v (resp. edge @e), numbering the
+ * junctions of the JSON from 0 and its edges after them, so that a feature has
+ * the same number however many vertices share its name; HEAD, TAIL and the
+ * dummy edge are NOFEATURE
+ */
+uint32_t vertex_feature(const overlay &ov, uintf v);
+uint32_t edge_feature(const network &net, uintf e);
+
+/* returns the number of features of @net, and the name of the feature @f
+ * (written to the GUID_TEXT bytes at @buf if it is a packed GUID; empty in
+ * low-memory mode, where find_names has the names)
  */
-void read_graph(const char *filename, const char *startingpoints);
+static inline uint32_t features(const network &net);
+static inline jstr feature_name(const network &net, uint32_t f, char *buf);
+
+/* returns the name of the feature @f as the ID tables store it: packed GUID's
+ * compare with memcmp as their text would, but not with other names
+ */
+static inline jstr feature_key(const network &net, uint32_t f);
 
 
 // ==== DEFINITIONS ==== //
 
-// edgenodes[e] stores a vector of all <u, v> pairs edge e represents
-static std::vector<std::vector<uintp> > edgenodes;
-// idx, edgeidx are the respective converses to name and edgename
-static std::unordered_map<std::string, uintf> idx, edgeidx;
-// edgevtx[e] maps each edge broken down (by reduction 1) to a vector of all
-// the vertices it became (since these have non-unique ID's)
-static std::unordered_map<uintf, std::vector<uintf> > edgevtx;
+// rough size in bytes of one row of an export, used to presize the ID tables
+#define ROW_BYTES 160
+
+// used by edgevtx for the edges that have not been broken down
+#define UNSPLIT UINT32_MAX
+
+// marks the vertices and edges that are no feature of the JSON
+#define NOFEATURE UINT32_MAX
+
+// in low-memory mode, the rows read between releases of the parsed JSON
+#define RELEASE_ROWS 65536
+
+// the rows of a batch passed between the two threads of pipe_rows, and the
+// batches in flight
+#define PIPE_ROWS 1024
+#define PIPE_BATCHES 8
+
+/* these return the index of the vertex (resp. edge) named @id, creating it if
+ * it does not already exist
+ */
+static uintf get_vertex(network &net, const jkey &id) {
+    bool added;
+    uintf v = net.idx.insert(id, added) + 2;
+    if (added)
+        ++net.nodes;
+    return v;
+}
+static uintf get_edge(network &net, const jkey &id) {
+    bool added;
+    uintf e = net.edgeidx.insert(id, added);
+    if (added)
+        ++net.edges;
+    return e;
+}
+
+/* adds the edge @e between @u and @v to the links of @net (resp. of the
+ * overlay @ov), bidirectionally
+ */
+static inline void add_link(network &net, uintf u, uintf v, uintf e) {
+    net.links.push_back(graph_link{(uint32_t)u, (uint32_t)v, (uint32_t)e});
+}
+static inline void add_link(overlay &ov, uintf u, uintf v, uintf e) {
+    ov.links.push_back(graph_link{(uint32_t)u, (uint32_t)v, (uint32_t)e});
+}
+
+/* fills the edgenodes of @net from its links, all of which must still come
+ * from rows
+ */
+static void build_edgenodes(network &net) {
+    const std::vector<graph_link> &links = net.links;
+    uintf edges = net.edges;
+    flat<std::pair<uint32_t, uint32_t> > &edgenodes = net.edgenodes;
+    std::vector<uint32_t> &first = net.edgefirst.vec;
+    first.assign(edges+1, 0);
+    for (const graph_link &l : links)
+        ++first[l.e+1];
+    for (uintf e = 0; e < edges; ++e)
+        first[e+1] += first[e];
+    edgenodes.vec.resize(links.size());
+    std::vector<uint32_t> fill(first.begin(), first.end()-1);
+    for (const graph_link &l : links)
+        edgenodes.vec[fill[l.e]++] = std::make_pair(l.u, l.v);
+    net.edgefirst.sync();
+    edgenodes.sync();
+    net.edgevtx.vec.assign(edges, UNSPLIT);
+    net.edgevtx.sync();
+}
+
+/* lays the links of @net out as its graph, keeping the order in which each
+ * vertex received its arcs, and releases them; the links of the edges broken
+ * down by reduction 1 are left out
+ */
+static void build_csr(network &net) {
+    csr &graph = net.graph;
+    std::vector<graph_link> &links = net.links;
+    uintf nodes = net.nodes;
+    std::vector<uint32_t> &first = graph.first.vec;
+    std::vector<arc> &arcs = graph.arcs.vec;
+    auto kept = [&net](const graph_link &l) {
+        return l.e == net.edges || net.edgevtx[l.e] == UNSPLIT;
+    };
+    first.assign(nodes+1, 0);
+    for (const graph_link &l : links) {
+        if (kept(l)) {
+            ++first[l.u+1];
+            ++first[l.v+1];
+        }
+    }
+    for (uintf v = 0; v < nodes; ++v)
+        first[v+1] += first[v];
+    arcs.resize(first[nodes]);
+    std::vector<uint32_t> fill(first.begin(), first.end()-1);
+    for (const graph_link &l : links) {
+        if (kept(l)) {
+            arcs[fill[l.u]++] = arc{l.v, l.e};
+            arcs[fill[l.v]++] = arc{l.u, l.e};
+        }
+    }
+    graph.first.sync();
+    graph.arcs.sync();
+    std::vector<graph_link>().swap(links);
+}
+
+/* lays the links of the overlay @ov out, each touched vertex keeping its base
+ * arcs (but those of the edges the starting points broke down or cut open)
+ * followed by its new ones, and releases them
+ */
+static void build_overlay(overlay &ov) {
+    const csr &graph = ov.net->graph;
+    uintf nodes = ov.net->nodes;
+    std::vector<uint32_t> order; // the touched vertices, as first met
+    std::vector<uint32_t> degree;
+    ov.touched.assign(ov.nodes, false);
+    auto touch = [&](uint32_t w) {
+        if (!ov.touched[w]) {
+            ov.touched[w] = true;
+            order.push_back(w);
+            degree.push_back(w < nodes
+                ? graph.first[w+1] - graph.first[w] : 0);
+        }
+    };
+    for (const graph_link &l : ov.links) {
+        touch(l.u);
+        touch(l.v);
+    }
+    // the ends of a chain cut open lose its edge even if nothing is linked
+    // to them [see contract.h]
+    for (uint32_t e : ov.cut) {
+        const std::pair<uint32_t, uint32_t> &ends
+            = ov.net->contracted.ends[e - ov.net->edges - 1];
+        touch(ends.first);
+        touch(ends.second);
+    }
+    // count the new arcs, then hand out the ranges
+    for (size_t k = 0; k < order.size(); ++k)
+        ov.range[order[k]] = std::make_pair(k, 0);
+    for (const graph_link &l : ov.links) {
+        ++degree[ov.range[l.u].first];
+        ++degree[ov.range[l.v].first];
+    }
+    uint32_t pos = 0;
+    for (size_t k = 0; k < order.size(); ++k) {
+        ov.range[order[k]] = std::make_pair(pos, pos);
+        pos += degree[k];
+    }
+    ov.arcs.resize(pos);
+    for (uint32_t w : order) {
+        if (w >= nodes)
+            continue;
+        uint32_t &fill = ov.range[w].second;
+        for (uint32_t i = graph.first[w]; i < graph.first[w+1]; ++i) {
+            uint32_t e = graph.arcs[i].edge;
+            if (!ov.edgevtx.count(e) && !ov.cut.count(e))
+                ov.arcs[fill++] = graph.arcs[i];
+        }
+    }
+    for (const graph_link &l : ov.links) {
+        ov.arcs[ov.range[l.u].second++] = arc{l.v, l.e};
+        ov.arcs[ov.range[l.v].second++] = arc{l.u, l.e};
+    }
+    std::vector<graph_link>().swap(ov.links);
+}
+
+/* drops whatever the overlay @ov held, leaving it empty over its network
+ */
+static void clear_overlay(overlay &ov) {
+    ov.nodes = ov.net->nodes;
+    ov.split.clear();
+    ov.edgevtx.clear();
+    ov.range.clear();
+    ov.arcs.clear();
+    ov.links.clear();
+    ov.cut.clear();
+    ov.pieces.clear();
+    ov.hung.clear();
+    ov.hungfeats.clear();
+}
+
+/* returns the first of the vertices the edge @e broke down into by reduction 1
+ * (in the base network @net, or else in the overlay @ov), or UNSPLIT if it
+ * has not been broken down yet
+ */
+static uintf split_vertex(const network &net, uintf e, const overlay &ov) {
+    if (net.edgevtx[e] != UNSPLIT)
+        return net.edgevtx[e];
+    std::unordered_map<uint32_t, uint32_t>::const_iterator it
+        = ov.edgevtx.find(e);
+    return it == ov.edgevtx.end() ? UNSPLIT : it->second;
+}
+
+/* connects the feature named @id of the network @net being built to @root
+ * (HEAD or TAIL) as in reduction 2, applying reduction 1 first if the feature
+ * is an edge
+ */
+static void attach(network &net, uintf root, const jkey &id) {
+    const flat<uint32_t> &edgefirst = net.edgefirst;
+    const flat<std::pair<uint32_t, uint32_t> > &edgenodes = net.edgenodes;
+    uintf edges = net.edges;
+    uintf v, e;
+    if ((v = net.idx.find(id)) != id_table::NONE) {
+        // the feature is a vertex
+        // so apply reduction 2
+        add_link(net, root, v+2, edges);
+    }
+    if ((e = net.edgeidx.find(id)) != id_table::NONE) {
+        // the feature is an edge
+        uintf first = net.edgevtx[e];
+        if (first == UNSPLIT) {
+            // the edge has not been decomposed yet
+            // so delete the edge
+            net.edgevtx.vec[e] = net.nodes;
+            for (uintf i = edgefirst[e]; i < edgefirst[e+1]; ++i) {
+                // first apply reduction 1
+                // add edge as vertex (sharing the name of its edge)
+                net.splitedge.vec.push_back(e);
+                uintf source = net.nodes++;
+                // connect new vertex to the root (reduction 2)
+                add_link(net, root, source, edges);
+                // complete reduction 1 by reconnecting edge
+                // to its endpoints
+                add_link(net, source, edgenodes[i].first, edges);
+                add_link(net, source, edgenodes[i].second, edges);
+            }
+            net.splitedge.sync();
+        } else {
+            // edge has already been decomposed
+            // so just apply reduction 2
+            for (v = first; v < first + edgefirst[e+1] - edgefirst[e]; ++v)
+                add_link(net, root, v, edges);
+        }
+    }
+}
 
-void read_graph(const char *filename, const char *startingpoints) {
-    name.emplace_back(); // HEAD name is unimportant
-    graph.emplace_back();
-    name.emplace_back(); // TAIL name is unimportant
-    graph.emplace_back();
+/* as above, for a query: the links and vertices this makes go into the
+ * overlay @ov on top of @net, which is only read
+ */
+static void attach(const network &net, uintf root, const jkey &id,
+        overlay &ov) {
+    const flat<uint32_t> &edgefirst = net.edgefirst;
+    const flat<std::pair<uint32_t, uint32_t> > &edgenodes = net.edgenodes;
+    uintf edges = net.edges;
+    uintf v, e;
+    if ((v = net.idx.find(id)) != id_table::NONE) {
+        // the feature is a vertex
+        // so apply reduction 2
+        add_link(ov, root, v+2, edges);
+    }
+    if ((e = net.edgeidx.find(id)) != id_table::NONE) {
+        // the feature is an edge
+        uintf first = split_vertex(net, e, ov);
+        if (first == UNSPLIT) {
+            // the edge has not been decomposed yet
+            // so delete the edge
+            ov.edgevtx[e] = ov.nodes;
+            for (uintf i = edgefirst[e]; i < edgefirst[e+1]; ++i) {
+                // first apply reduction 1
+                // add edge as vertex (sharing the name of its edge)
+                ov.split.push_back(e);
+                uintf source = ov.nodes++;
+                // connect new vertex to the root (reduction 2)
+                add_link(ov, root, source, edges);
+                // complete reduction 1 by reconnecting edge
+                // to its endpoints
+                add_link(ov, source, edgenodes[i].first, edges);
+                add_link(ov, source, edgenodes[i].second, edges);
+            }
+        } else {
+            // edge has already been decomposed
+            // so just apply reduction 2
+            for (v = first; v < first + edgefirst[e+1] - edgefirst[e]; ++v)
+                add_link(ov, root, v, edges);
+        }
+    }
+}
 
-    FILE *file = fopen(filename, "r");
-    nodes = 2; // the two nodes are HEAD and TAIL
+/* notes @id as a controller of the network @net being built, and attaches it
+ * to TAIL (an ID the rows do not name is only noted)
+ */
+static void add_controller(network &net, const jkey &id) {
+    std::vector<char> &names = net.ctrlnames.vec;
+    std::vector<uint64_t> &first = net.ctrlfirst.vec;
+    if (first.empty())
+        first.push_back(0);
+    names.insert(names.end(), id.str.s, id.str.s + id.str.n);
+    first.push_back(names.size());
+    net.ctrlnames.sync();
+    net.ctrlfirst.sync();
+    attach(net, TAIL, id);
+}
 
-    uintf edges = 0, controllers = 0;
+/* reads the rows of the "rows" list from the json @file, which must be
+ * positioned inside the list (before a row), until the list (or the input)
+ * ends, and calls the function-type @action with the edge, source and target
+ * ID's of each, whatever the order of their keys
+ */
+template<typename FUNC>
+static void scan_rows(json_file &file, const FUNC &action) {
+    static const json_keys<3> keys({
+        "\"viaGlobalId\"", "\"fromGlobalId\"", "\"toGlobalId\""
+    });
+    for (;;) {
+        jkey edge, source, target;
+        if (!scan_field(file, keys, [&](uintf i) {
+            switch(i) {
+                case 0: // viaGlobalId
+                extract_string(file, edge);
+                return;
+                case 1: // fromGlobalId
+                extract_string(file, source);
+                return;
+                case 2: // toGlobalId
+                extract_string(file, target);
+                return;
+                default:
+                return;
+            }
+        }))
+            return; // the list has ended
+        action(edge, source, target);
+    }
+}
 
+/* as above, with the fast reader unless built with ROBUST: it takes the keys
+ * of each row to come in the order below, and hands over to scan_rows (from
+ * the row breaking it) as soon as a row does not
+ */
+template<typename FUNC>
+static void read_rows(json_file &file, const FUNC &action) {
     #ifdef ROBUST
-    // this is the key-order-independent implementation of the graph reader
-    scan_field(file, { "\"rows\"", "\"controllers\"" }, [&, file](uintf i) {
+    scan_rows(file, action);
+    #else
+    // a row breaks the order when one of its keys is not found after the one
+    // before it (the search then runs into the end of the row), or is found
+    // nested in a value or as a value itself
+    jkey edge, source, target;
+    json_mark row = json_tell(file);
+    auto next_key = [&file](const char *key, uint_fast32_t level,
+            jkey &value) {
+        if (!read_to_key(file, key) || file.braces != level || !at_key(file))
+            return false;
+        extract_string(file, value);
+        return true;
+    };
+    for (; begin_field(file); end_field(file), row = json_tell(file)) {
+        uint_fast32_t level = file.braces;
+        if (!next_key("\"viaGlobalId\"", level, edge)
+                || !next_key("\"fromGlobalId\"", level, source)
+                || !next_key("\"toGlobalId\"", level, target)) {
+            json_seek(file, row);
+            scan_rows(file, action);
+            return;
+        }
+        action(edge, source, target);
+    }
+    #endif
+}
+
+/* the ID's and rows of one chunk of the "rows" list, with vertices and edges
+ * indexed locally in the order in which they first appear in the chunk
+ */
+struct row_chunk {
+    const char *begin, *end; // the bytes of the chunk
+    uintf braces, brackets; // the levels of the list holding the rows
+    id_table vidx, eidx; // the local vertex and edge tables
+    // <edge, <source, target> > triples of local indices, in order
+    std::vector<std::pair<uintf, uintp> > rows;
+};
+
+/* reads the rows of the "rows" list from the json @file (as read_rows does)
+ * into the local tables of @c, expecting about @bytes bytes of them
+ */
+static void chunk_rows(row_chunk &c, json_file &file, size_t bytes) {
+    size_t rows = bytes / ROW_BYTES + 1;
+    c.vidx.reserve(rows, 0);
+    c.eidx.reserve(rows, 0);
+    bool added;
+    read_rows(file, [&](const jkey &edge, const jkey &source,
+            const jkey &target) {
+        // same lookup order as the serial reader: source, target, then edge
+        uintf sourcev = c.vidx.insert(source, added);
+        uintf targetv = c.vidx.insert(target, added);
+        uintf edgev = c.eidx.insert(edge, added);
+        c.rows.emplace_back(edgev, uintp(sourcev, targetv));
+    });
+}
+
+/* parses the rows of the chunk @c into its local tables
+ */
+static void parse_chunk(row_chunk &c) {
+    json_file part;
+    json_buffer(part, c.begin, c.end - c.begin);
+    part.braces = c.braces;
+    part.brackets = c.brackets;
+    chunk_rows(c, part, c.end - c.begin);
+}
+
+/* assigns global indices of @net to the ID's of the parsed chunk @c and adds
+ * its rows to the graph. Merging the chunks in order reproduces the serial
+ * reader: an ID new to the graph is met first in its chunk's local order,
+ * which is the order in which the serial reader would have met it.
+ */
+static void merge_chunk(network &net, const row_chunk &c) {
+    std::vector<uintf> vmap(c.vidx.size()), emap(c.eidx.size());
+    // the hashes computed by the chunk's thread are reused
+    for (uintf i = 0; i < c.vidx.size(); ++i)
+        vmap[i] = get_vertex(net, jkey(c.vidx.key(i), c.vidx.hash(i)));
+    for (uintf i = 0; i < c.eidx.size(); ++i)
+        emap[i] = get_edge(net, jkey(c.eidx.key(i), c.eidx.hash(i)));
+    for (const std::pair<uintf, uintp> &row : c.rows)
+        add_link(net, vmap[row.second.first], vmap[row.second.second],
+            emap[row.first]);
+    net.stats.probes += c.vidx.probes + c.eidx.probes;
+}
+
+/* a batch of rows passed from the thread reading them to the thread adding
+ * them to the graph: the <edge, source, target> ID's of each row (views into
+ * the JSON), and where in the JSON the batch starts
+ */
+struct row_batch {
+    std::vector<std::array<jkey, 3> > rows;
+    const char *from;
+};
+
+/* reads the rows of the "rows" list from the json @file as the serial reader
+ * does, while a second thread adds them to the graph of @net in the same
+ * order: the rows pass between the two in batches through a ring [see
+ * spsc.h], so that scanning the JSON overlaps with the cache misses of the
+ * ID tables
+ */
+static void pipe_rows(network &net, json_file &file) {
+    spsc_ring<row_batch> ring(PIPE_BATCHES);
+    std::thread builder([&net, &ring]() {
+        for (row_batch *b; (b = ring.front()); ring.pop()) {
+            for (const std::array<jkey, 3> &row : b->rows) {
+                uintf sourcev = get_vertex(net, row[1]);
+                uintf targetv = get_vertex(net, row[2]);
+                add_link(net, sourcev, targetv, get_edge(net, row[0]));
+            }
+        }
+    });
+    bool low = net.idx.fingerprint;
+    size_t rows = 0;
+    row_batch *b = &ring.claim();
+    b->rows.clear();
+    b->from = file.pos;
+    read_rows(file, [&](const jkey &edge, const jkey &source,
+            const jkey &target) {
+        b->rows.push_back({{ edge, source, target }});
+        if (b->rows.size() == PIPE_ROWS) {
+            ring.push();
+            b = &ring.claim();
+            b->rows.clear();
+            b->from = file.pos;
+        }
+        if (low && ++rows % RELEASE_ROWS == 0) {
+            // only the JSON behind the rows still waiting in the ring
+            const row_batch *wait = ring.oldest();
+            json_release(file, wait ? wait->from : b->from);
+        }
+    });
+    ring.push();
+    ring.close();
+    builder.join();
+}
+
+/* reads the rows of the "rows" list from the json @file, which must be
+ * positioned just inside the list, adding them to the graph of @net. With
+ * more than one thread, a structural sweep first cuts the list into @threads
+ * chunks at row boundaries, leaving the @file just past the list; with
+ * @pipeline set, the rows are read and added on two threads instead [see
+ * pipe_rows].
+ */
+static void load_rows(network &net, json_file &file, uintf threads,
+        bool pipeline) {
+    if (pipeline) {
+        pipe_rows(net, file);
+        return;
+    }
+    if (threads <= 1) {
+        read_rows(file, [&net, &file](const jkey &edge, const jkey &source,
+                const jkey &target) {
+            uintf sourcev = get_vertex(net, source);
+            uintf targetv = get_vertex(net, target);
+            add_link(net, sourcev, targetv, get_edge(net, edge));
+            if (net.idx.fingerprint && net.links.size() % RELEASE_ROWS == 0)
+                json_release(file);
+        });
+        return;
+    }
+
+    std::vector<row_chunk> chunks(1);
+    uintf braces = file.braces, brackets = file.brackets;
+    json_load(file); // the chunks are cut from the whole of the input
+    // the rows dominate the file, so aim for equal shares of what remains
+    size_t step = (file.end - file.pos) / threads + 1;
+    chunks[0].begin = file.pos;
+    for (char c = next_level(file); c != '\0' && brackets <= file.brackets;
+            c = next_level(file)) {
+        if (c == '{' && file.braces == braces+1 && file.brackets == brackets
+                && (size_t)(file.pos-1 - chunks.back().begin) >= step) {
+            // a row starts here, far enough from the last cut
+            chunks.back().end = file.pos-1;
+            chunks.emplace_back();
+            chunks.back().begin = file.pos-1;
+        }
+    }
+    // the list ends just before the closing bracket (if it was read)
+    chunks.back().end = brackets > file.brackets ? file.pos-1 : file.pos;
+
+    std::vector<std::thread> workers;
+    for (row_chunk &c : chunks) {
+        c.braces = braces;
+        c.brackets = brackets;
+        workers.emplace_back(parse_chunk, std::ref(c));
+    }
+    for (std::thread &t : workers)
+        t.join();
+    for (const row_chunk &c : chunks)
+        merge_chunk(net, c);
+}
+
+/* reads the network in the json @file, positioned at its start: calls the
+ * function-type @rows once the file is positioned just inside the "rows" list
+ * (which @rows must read to its end), and @ctrl with the ID of each of the
+ * "controllers" (a view into the file)
+ *
+ * returns false if the JSON holds no object, or ends inside one (or inside a
+ * list or string)
+ */
+template<typename ROWS, typename CTRL>
+static bool read_network(json_file &file, const ROWS &rows, const CTRL &ctrl) {
+    // the top level is read key-order-independently by both readers, as it
+    // only costs a handful of keys
+    static const json_keys<2> keys({ "\"rows\"", "\"controllers\"" });
+    static const json_keys<1> ctrlkeys({ "\"globalId\"" });
+    jkey id;
+    bool found = scan_field(file, keys, [&](uintf i) {
         switch(i) {
             case 0: // rows
-            scan_list(file, [&, file](void) {
-                std::string edge, source, target;
-                uintf edgev, sourcev, targetv; // corresponding index values
-                std::unordered_map<std::string, uintf>::iterator it;
-
-                if (scan_field(file, {
-                    "\"viaGlobalId\"", "\"fromGlobalId\"", "\"toGlobalId\""
-                }, [&, file](uintf i) {
-                    switch(i) {
-                        case 0: // viaGlobalId
-                        extract_string(file, edge);
-                        return;
-                        case 1: // fromGlobalId
-                        extract_string(file, source);
-                        return;
-                        case 2: // toGlobalId
-                        extract_string(file, target);
-                        return;
-                        default:
-                        return;
-                    }
-                })) {
-                    if ((it = idx.find(source)) == idx.end()) {
-                        // source vertex does not already exist
-                        name.push_back(source);
-                        graph.emplace_back();
-                        idx[source] = sourcev = nodes++;
-                    } else sourcev = it->second;
-                    if ((it = idx.find(target)) == idx.end()) {
-                        // target vertex does not already exist
-                        name.push_back(target);
-                        graph.emplace_back();
-                        idx[target] = targetv = nodes++;
-                    } else targetv = it->second;
-                    if ((it = edgeidx.find(edge)) == edgeidx.end()) {
-                        // edge identifier does not already exist
-                        edgenodes.emplace_back();
-                        edgename.push_back(edge);
-                        badedge.push_back(false);
-                        edgeidx[edge] = edgev = edges++;
-                    } else edgev = it->second;
-
-                    // append <u, v> std::pair to edge
-                    edgenodes[edgev].emplace_back(sourcev, targetv);
-
-                    // append edge to graph, bidirectionally
-                    graph[sourcev].emplace_back(targetv, edgev);
-                    graph[targetv].emplace_back(sourcev, edgev);
-                }
+            scan_list(file, [&](void) {
+                rows();
             });
-            // create an additional dummy edge for reduction 1
-            edgename.emplace_back();
-            badedge.push_back(false);
             return;
             case 1: // controllers
-            scan_list(file, [&, file](void) {
-                std::string ctrl;
-                if (scan_field(file, { "\"globalId\"" }, [file, &ctrl](int) {
-                    extract_string(file, ctrl);
-                })) {
-                    ++controllers;
-                    std::unordered_map<std::string, uintf>::iterator it;
-                    if ((it = idx.find(ctrl)) != idx.end()) {
-                        // the controller is a vertex
-                        // so apply reduction 2
-                        graph[TAIL].emplace_back(it->second, edges);
-                        graph[it->second].emplace_back(TAIL, edges);
-                    }
-                    if ((it = edgeidx.find(ctrl)) != edgeidx.end()) {
-                        // the controller is an edge
-                        if (!badedge[it->second]) {
-                            // the edge has not been decomposed yet
-                            badedge[it->second] = true; // delete the edge
-                            std::unordered_map<uintf, std::vector<uintf> >::iterator jt = edgevtx.emplace(it->second, std::vector<uintf>()).first;
-                            for (const uintp &p : edgenodes[it->second]) {
-                                // first apply reduction 1
-                                // add edge as vertex
-                                name.push_back(ctrl);
-                                graph.emplace_back();
-                                uintf source = nodes++;
-                                jt->second.push_back(source);
-                                // connect new edge to TAIL (reduction 2)
-                                graph[TAIL].emplace_back(source, edges);
-                                graph[source].emplace_back(TAIL, edges);
-                                // complete reduction 1 by reconnecting edge
-                                // to its endpoints
-                                graph[source].emplace_back(p.first, edges);
-                                graph[p.first].emplace_back(source, edges);
-                                graph[source].emplace_back(p.second, edges);
-                                graph[p.second].emplace_back(source, edges);
-                            }
-                        } else {
-                            // edge has already been decomposed
-                            // so just apply reduction 2
-                            for (const uintf &v : edgevtx[it->second]) {
-                                graph[TAIL].emplace_back(v, edges);
-                                graph[v].emplace_back(TAIL, edges);
-                            }
-                        }
-                    }
-                }
+            scan_list(file, [&](void) {
+                if (scan_field(file, ctrlkeys, [&](int) {
+                    extract_string(file, id);
+                }))
+                    ctrl(id);
             });
             return;
             default:
             return;
         }
     });
-    #else
-    // this is the key-order-dependent algorithm, which behaves analogously with
-    // the additional assumption that keys come in precisely the order specified
-    // below
-    begin_field(file);
-    read_to_key(file, "\"rows\"");
-    for (begin_list(file); begin_field(file); end_field(file)) {
-        std::string edge, source, target;
-        uintf edgev, sourcev, targetv;
-        std::unordered_map<std::string, uintf>::iterator it;
-
-        read_to_key(file, "\"viaGlobalId\"");
-        extract_string(file, edge);
-        read_to_key(file, "\"fromGlobalId\"");
-        extract_string(file, source);
-        read_to_key(file, "\"toGlobalId\"");
-        extract_string(file, target);
-
-        if ((it = idx.find(source)) == idx.end()) {
-            name.push_back(source);
-            graph.emplace_back();
-            idx[source] = sourcev = nodes++;
-        } else sourcev = it->second;
-        if ((it = idx.find(target)) == idx.end()) {
-            name.push_back(target);
-            graph.emplace_back();
-            idx[target] = targetv = nodes++;
-        } else targetv = it->second;
-        if ((it = edgeidx.find(edge)) == edgeidx.end()) {
-            edgenodes.emplace_back();
-            edgename.push_back(edge);
-            badedge.push_back(false);
-            edgeidx[edge] = edgev = edges++;
-        } else edgev = it->second;
-
-        edgenodes[edgev].emplace_back(sourcev, targetv);
-
-        graph[sourcev].emplace_back(targetv, edgev);
-        graph[targetv].emplace_back(sourcev, edgev);
-    }
+    return found && !file.braces && !file.brackets && !file.instring;
+}
 
-    edgename.emplace_back();
-    badedge.push_back(false); // dummy edge for graph modification
+/* one of several JSON files holding a network between them: the file, where
+ * it starts, its rows, parsed into local tables as a chunk of the rows is, and
+ * its controllers (views into the file)
+ */
+struct row_shard {
+    json_file file;
+    const char *begin;
+    row_chunk rows;
+    std::vector<jkey> ctrls;
+    bool ok = false; // whether the JSON was whole
+};
 
-    read_to_key(file, "\"controllers\"");
-    std::string ctrl;
-    for (begin_list(file); begin_field(file); end_field(file)) {
-        read_to_key(file, "\"globalId\"");
-        extract_string(file, ctrl);
+/* parses the rows and controllers of the shard @s, opened at its start
+ */
+static void parse_shard(row_shard &s) {
+    size_t bytes = json_expected(s.file);
+    s.ok = read_network(s.file, [&s, bytes](void) {
+        chunk_rows(s.rows, s.file, bytes);
+    }, [&s](const jkey &ctrl) {
+        s.ctrls.push_back(ctrl);
+    });
+}
 
-        ++controllers;
-        std::unordered_map<std::string, uintf>::iterator it;
-        if ((it = idx.find(ctrl)) != idx.end()) {
-            graph[TAIL].emplace_back(it->second, edges);
-            graph[it->second].emplace_back(TAIL, edges);
-        }
-        if ((it = edgeidx.find(ctrl)) != edgeidx.end()) {
-            if (!badedge[it->second]) {
-                badedge[it->second] = true;
-                std::unordered_map<uintf, std::vector<uintf> >::iterator jt = edgevtx.emplace(it->second, std::vector<uintf>()).first;
-                for (auto &p : edgenodes[it->second]) {
-                    name.push_back(ctrl);
-                    graph.emplace_back();
-                    uintf source = nodes++;
-                    jt->second.push_back(source);
-                    graph[TAIL].emplace_back(source, edges);
-                    graph[source].emplace_back(TAIL, edges);
-
-                    graph[source].emplace_back(p.first, edges);
-                    graph[p.first].emplace_back(source, edges);
-                    graph[source].emplace_back(p.second, edges);
-                    graph[p.second].emplace_back(source, edges);
-                }
-            } else {
-                for (const uintf &v : edgevtx[it->second]) {
-                    graph[TAIL].emplace_back(v, edges);
-                    graph[v].emplace_back(TAIL, edges);
-                }
-            }
+/* builds @net from the json @file, positioned at its start, and closes the
+ * file; the phases are timed from @clock
+ */
+static bool build_graph(network &net, json_file &file, uintf threads,
+        bool pipeline, stat_time clock) {
+    run_stats &stats = net.stats;
+    const char *begin = file.pos;
+    size_t bytes = json_expected(file);
+    // expect about one new vertex and one new edge per row
+    size_t rows = bytes / ROW_BYTES + 1;
+    net.idx.reserve(rows, bytes / 4);
+    net.edgeidx.reserve(rows, bytes / 4);
+    net.links.reserve(rows);
+
+    net.nodes = 2; // the two nodes are HEAD and TAIL
+    net.edges = 0;
+
+    // the controllers may come before the rows, so they are attached once the
+    // whole file is read (their ID's are views into the file)
+    std::vector<jkey> ctrls;
+    bool whole = read_network(file, [&](void) {
+        clock = stat_clock();
+        load_rows(net, file, threads, pipeline);
+        build_edgenodes(net);
+        stats.rows = net.links.size();
+        stat_phase(stats, PH_ROWS, clock);
+    }, [&ctrls](const jkey &ctrl) {
+        ctrls.push_back(ctrl);
+    });
+    // the controllers are attached to TAIL (reduction 2)
+    for (const jkey &ctrl : ctrls)
+        add_controller(net, ctrl);
+    stat_phase(stats, PH_CONTROLLERS, clock);
+    clock = stat_clock();
+    stats.bytes = file.end - begin;
+    if (!json_close(file) || !whole)
+        return false;
+
+    build_csr(net);
+    stats.probes += net.idx.probes + net.edgeidx.probes;
+    stats.collisions = net.idx.collisions + net.edgeidx.collisions;
+    stats.vertices = net.nodes - 2;
+    stats.edges = net.edges;
+    stat_phase(stats, PH_LAYOUT, clock);
+    return true;
+}
+
+bool read_graph(network &net, const char *filename, uintf threads,
+        bool low_memory, bool pipeline) {
+    stat_time clock = stat_clock();
+    json_file file;
+    if (!json_open(file, filename))
+        return false;
+    net.source = filename;
+    net.idx.fingerprint = net.edgeidx.fingerprint = low_memory;
+    return build_graph(net, file, threads, pipeline, clock);
+}
+
+bool parse_graph(network &net, const char *data, size_t len,
+        uintf threads, bool pipeline) {
+    stat_time clock = stat_clock();
+    json_file file;
+    json_buffer(file, data, len);
+    return build_graph(net, file, threads, pipeline, clock);
+}
+
+bool read_shards(network &net, const std::vector<std::string> &filenames) {
+    run_stats &stats = net.stats;
+    stat_time clock = stat_clock();
+    std::vector<row_shard> shards(filenames.size());
+    bool ok = true;
+    size_t bytes = 0;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        ok = json_open(shards[i].file, filenames[i].c_str()) && ok;
+        shards[i].begin = shards[i].file.pos;
+        bytes += json_expected(shards[i].file);
+    }
+    if (ok) {
+        std::vector<std::thread> workers;
+        for (row_shard &s : shards)
+            workers.emplace_back(parse_shard, std::ref(s));
+        for (std::thread &t : workers)
+            t.join();
+
+        // the ID's new to the network are met in the same order as if the
+        // files were joined, so they get the same indices
+        size_t rows = bytes / ROW_BYTES + 1;
+        net.idx.reserve(rows, bytes / 4);
+        net.edgeidx.reserve(rows, bytes / 4);
+        net.links.reserve(rows);
+        net.nodes = 2; // the two nodes are HEAD and TAIL
+        net.edges = 0;
+        for (const row_shard &s : shards)
+            merge_chunk(net, s.rows);
+        build_edgenodes(net);
+        stats.rows = net.links.size();
+        stat_phase(stats, PH_ROWS, clock);
+        for (const row_shard &s : shards) {
+            for (const jkey &ctrl : s.ctrls)
+                add_controller(net, ctrl);
         }
+        stat_phase(stats, PH_CONTROLLERS, clock);
     }
-    end_field(file);
-    #endif
+    for (row_shard &s : shards) {
+        stats.bytes += s.file.end - s.begin;
+        ok = json_close(s.file) && s.ok && ok;
+    }
+    if (!ok)
+        return false;
+
+    build_csr(net);
+    stats.probes += net.idx.probes + net.edgeidx.probes;
+    stats.collisions = net.idx.collisions + net.edgeidx.collisions;
+    stats.vertices = net.nodes - 2;
+    stats.edges = net.edges;
+    stat_phase(stats, PH_LAYOUT, clock);
+    return true;
+}
 
-    fclose(file);
+template<typename FUNC>
+bool find_names(const network &net, const std::vector<uint32_t> &wanted,
+        const FUNC &action) {
+    std::vector<bool> want(features(net), false);
+    for (uint32_t f : wanted)
+        want[f] = true;
+    json_file file;
+    if (!json_open(file, net.source.c_str()))
+        return false;
+    // passes on the name of @id if it is that of a wanted feature of @table,
+    // whose features are numbered from @base
+    auto name = [&](const jkey &id, const id_table &table, uint32_t base) {
+        uintf i = table.find(id);
+        if (i != id_table::NONE && want[base + i]) {
+            want[base + i] = false;
+            action(base + i, id.str);
+        }
+    };
+    size_t rows = 0;
+    auto row = [&](const jkey &edge, const jkey &source, const jkey &target) {
+        name(source, net.idx, 0);
+        name(target, net.idx, 0);
+        name(edge, net.edgeidx, net.idx.size());
+        if (++rows % RELEASE_ROWS == 0)
+            json_release(file);
+    };
+    static const json_keys<1> keys({ "\"rows\"" });
+    scan_field(file, keys, [&](uintf) {
+        scan_list(file, [&](void) {
+            read_rows(file, row);
+        });
+    });
+    return json_close(file);
+}
 
+void set_startingpoints(overlay &ov, const std::vector<std::string> &ids) {
+    clear_overlay(ov);
     // starting points, done in a similar fashion to controllers
+    for (const std::string &id : ids)
+        attach(*ov.net, HEAD, jkey(id), ov);
+    build_overlay(ov);
+}
+
+void read_startingpoints(overlay &ov, const char *startingpoints) {
+    std::vector<std::string> ids;
+    read_ids(startingpoints, ids);
+    set_startingpoints(ov, ids);
+}
+
+bool read_ids(const char *filename, std::vector<std::string> &ids) {
     std::string in;
-    std::ifstream fin(startingpoints);
-    while (std::getline(fin, in)) {
-        in.push_back('\n');
-        std::unordered_map<std::string, uintf>::iterator it;
-        if ((it = idx.find(in)) != idx.end()) {
-            // starting point is a vertex
-            // so apply reduction 2
-            graph[HEAD].emplace_back(it->second, edges);
-            graph[it->second].emplace_back(HEAD, edges);
-        }
-        if ((it = edgeidx.find(in)) != edgeidx.end()) {
-            // starting point is an edge
-            if (!badedge[it->second]) {
-                badedge[it->second] = true;
-                std::unordered_map<uintf, std::vector<uintf> >::iterator jt = edgevtx.emplace(it->second, std::vector<uintf>()).first;
-                for (const uintp &p : edgenodes[it->second]) {
-                    // first apply reduction 1
-                    name.push_back(in);
-                    graph.emplace_back();
-                    uintf source = nodes++;
-                    jt->second.push_back(source);
-                    // add point to HEAD (reduction 2)
-                    graph[HEAD].emplace_back(source, edges);
-                    graph[source].emplace_back(HEAD, edges);
-                    // complete reduction 1
-                    graph[source].emplace_back(p.first, edges);
-                    graph[p.first].emplace_back(source, edges);
-                    graph[source].emplace_back(p.second, edges);
-                    graph[p.second].emplace_back(source, edges);
-                }
-            } else {
-                for (const uintf &v : edgevtx[it->second]) {
-                    // apply reduction 2
-                    graph[HEAD].emplace_back(v, edges);
-                    graph[v].emplace_back(HEAD, edges);
-                }
-            }
-        }
-    }
+    std::ifstream fin(filename);
+    if (!fin)
+        return false;
+    while (std::getline(fin, in))
+        ids.push_back(in);
     fin.close();
+    return true;
+}
+
+static inline void neighbours(const overlay &ov, uintf v, const arc *&begin,
+        const arc *&end) {
+    if (v < ov.touched.size() && ov.touched[v]) {
+        const std::pair<uint32_t, uint32_t> &r = ov.range.find(v)->second;
+        begin = ov.arcs.data() + r.first;
+        end = ov.arcs.data() + r.second;
+    } else {
+        const csr &graph = ov.net->graph;
+        begin = graph.arcs.data() + graph.first[v];
+        end = graph.arcs.data() + graph.first[v+1];
+    }
+}
+
+jstr vertex_name(const overlay &ov, uintf v, char *buf) {
+    uint32_t f = vertex_feature(ov, v);
+    return f == NOFEATURE ? jstr() : feature_name(*ov.net, f, buf);
+}
+
+jstr edge_name(const network &net, uintf e, char *buf) {
+    uint32_t f = edge_feature(net, e);
+    return f == NOFEATURE ? jstr() : feature_name(net, f, buf);
+}
+
+uint32_t vertex_feature(const overlay &ov, uintf v) {
+    const network &net = *ov.net;
+    if (!REAL(v))
+        return NOFEATURE;
+    if (v-2 < net.idx.size())
+        return v-2;
+    if (v < net.nodes)
+        return net.idx.size() + net.splitedge[v-2 - net.idx.size()];
+    return net.idx.size() + ov.split[v - net.nodes];
+}
+
+uint32_t edge_feature(const network &net, uintf e) {
+    return e < net.edgeidx.size() ? net.idx.size() + e : NOFEATURE;
+}
+
+static inline uint32_t features(const network &net) {
+    return net.idx.size() + net.edgeidx.size();
+}
+
+static inline jstr feature_name(const network &net, uint32_t f, char *buf) {
+    if (net.idx.fingerprint)
+        return jstr();
+    return f < net.idx.size() ? net.idx.name(f, buf)
+        : net.edgeidx.name(f - net.idx.size(), buf);
+}
+
+static inline jstr feature_key(const network &net, uint32_t f) {
+    if (net.idx.fingerprint)
+        return jstr();
+    return f < net.idx.size() ? net.idx.key(f)
+        : net.edgeidx.key(f - net.idx.size());
 }
 
 #endif
@@ -0,0 +1,213 @@
+/* VERTEX REORDERING
+ * author: Zach Goldthorpe
+ *
+ * The file provides the optional pass renumbering the vertices of the base
+ * network once it is built, so that the vertices traverse() meets one after
+ * the other also lie close together in graph, dfs and upstream. The reader
+ * numbers the junctions in the order the rows first name them, which follows
+ * whatever order the rows were exported in rather than the network itself.
+ *
+ * The junctions are renumbered in one of three orders:
+ *  bfs: breadth-first from TAIL (the controllers), then from every junction
+ *       not reached yet, in turn;
+ *  rcm: reverse Cuthill-McKee, that is breadth-first with the neighbours of a
+ *       vertex taken by increasing degree, starting each component from one of
+ *       its vertices of least degree, and reversed;
+ *  dfs: preorder of a depth-first search from TAIL, then from every junction
+ *       not reached yet, as with bfs.
+ * The searches go from TAIL because HEAD has no arcs in the base network (the
+ * starting points only come with the queries), and TAIL is where every search
+ * of traverse() ends up.
+ *
+ * HEAD and TAIL stay at 0 and 1, and the vertices reduction 1 made from the
+ * controller edges stay where they are (after the junctions), so a junction
+ * keeps being the vertex after its index in idx [see read_graph.h]: idx itself
+ * is permuted to match, along with the arcs and the ends of the edges. The
+ * edges and their indices do not change.
+ *
+ * reorder_network: renumber the junctions of the base network
+ */
+
+#ifndef _reorder_h_
+#define _reorder_h_
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "read_graph.h"
+
+enum reorder_kind { REORDER_NONE, REORDER_BFS, REORDER_RCM, REORDER_DFS };
+
+/* returns the order named @name ("bfs", "rcm" or "dfs"), or REORDER_NONE if
+ * there is none such
+ */
+reorder_kind reorder_named(const char *name);
+
+/* renumbers the junctions of the base network @net (built from the JSON,
+ * before any index is built on it) in the order @kind
+ */
+void reorder_network(network &net, reorder_kind kind);
+
+
+// ==== DEFINITIONS ==== //
+
+reorder_kind reorder_named(const char *name) {
+    static const char *const names[] = { "bfs", "rcm", "dfs" };
+    for (int k = 0; k < 3; ++k) {
+        if (!strcmp(name, names[k]))
+            return (reorder_kind)(REORDER_BFS + k);
+    }
+    return REORDER_NONE;
+}
+
+/* returns the number of arcs of vertex @v of the graph @graph
+ */
+static inline uint32_t base_degree(const csr &graph, uintf v) {
+    return graph.first[v+1] - graph.first[v];
+}
+
+/* sorts the vertices @order[from..] of @graph by increasing degree, keeping
+ * ties in order; they are the new neighbours of a vertex, so usually only a few
+ */
+static void sort_by_degree(const csr &graph, std::vector<uint32_t> &order,
+        size_t from) {
+    auto less = [&graph](uint32_t a, uint32_t b) {
+        return base_degree(graph, a) < base_degree(graph, b);
+    };
+    if (order.size() - from > 16) {
+        std::stable_sort(order.begin() + from, order.end(), less);
+        return;
+    }
+    for (size_t j = from + 1; j < order.size(); ++j) {
+        uint32_t w = order[j];
+        size_t k = j;
+        for (; k > from && less(w, order[k-1]); --k)
+            order[k] = order[k-1];
+        order[k] = w;
+    }
+}
+
+/* lists the vertices of the base network @net in the order @kind, each once
+ * (HEAD and TAIL included)
+ */
+static std::vector<uint32_t> vertex_order(const network &net,
+        reorder_kind kind) {
+    const csr &graph = net.graph;
+    uintf nodes = net.nodes;
+    std::vector<uint32_t> order;
+    order.reserve(nodes);
+    std::vector<bool> seen(nodes, false);
+    seen[HEAD] = true;
+    order.push_back(HEAD);
+    // where the searches start: TAIL then every vertex, or every vertex by
+    // increasing degree (a counting sort, keeping ties in order) for rcm
+    std::vector<uint32_t> starts;
+    starts.reserve(nodes);
+    starts.push_back(TAIL);
+    for (uintf v = 2; v < nodes; ++v)
+        starts.push_back(v);
+    if (kind == REORDER_RCM) {
+        std::vector<uint32_t> at;
+        for (uint32_t v : starts) {
+            if (base_degree(graph, v) + 1 >= at.size())
+                at.resize(base_degree(graph, v) + 2, 0);
+            ++at[base_degree(graph, v) + 1];
+        }
+        for (size_t d = 1; d < at.size(); ++d)
+            at[d] += at[d-1];
+        std::vector<uint32_t> sorted(starts.size());
+        for (uint32_t v : starts)
+            sorted[at[base_degree(graph, v)]++] = v;
+        starts.swap(sorted);
+    }
+    std::vector<std::pair<uint32_t, uint32_t> > stk; // <vertex, next arc>
+    for (uint32_t s : starts) {
+        if (seen[s])
+            continue;
+        seen[s] = true;
+        order.push_back(s);
+        if (kind == REORDER_DFS) {
+            stk.push_back(std::make_pair(s, graph.first[s]));
+            while (!stk.empty()) {
+                std::pair<uint32_t, uint32_t> &top = stk.back();
+                if (top.second == graph.first[top.first+1]) {
+                    stk.pop_back();
+                    continue;
+                }
+                uint32_t w = graph.arcs[top.second++].to;
+                if (!seen[w]) {
+                    seen[w] = true;
+                    order.push_back(w);
+                    stk.push_back(std::make_pair(w, graph.first[w]));
+                }
+            }
+            continue;
+        }
+        // the queue of the breadth-first search is the tail of order
+        for (size_t q = order.size() - 1; q < order.size(); ++q) {
+            uint32_t v = order[q];
+            size_t fresh = order.size();
+            for (uint32_t i = graph.first[v]; i < graph.first[v+1]; ++i) {
+                uint32_t w = graph.arcs[i].to;
+                if (!seen[w]) {
+                    seen[w] = true;
+                    order.push_back(w);
+                }
+            }
+            if (kind == REORDER_RCM)
+                sort_by_degree(graph, order, fresh);
+        }
+    }
+    if (kind == REORDER_RCM)
+        std::reverse(order.begin(), order.end());
+    return order;
+}
+
+void reorder_network(network &net, reorder_kind kind) {
+    if (kind == REORDER_NONE)
+        return;
+    csr &graph = net.graph;
+    uintf nodes = net.nodes, junctions = net.idx.size();
+    // the junctions in their new order, as indices of idx, and the new number
+    // of every vertex
+    std::vector<uint32_t> moved;
+    moved.reserve(junctions);
+    for (uint32_t v : vertex_order(net, kind)) {
+        if (REAL(v) && v-2 < junctions)
+            moved.push_back(v-2);
+    }
+    std::vector<uint32_t> renumber(nodes);
+    for (uintf v = 0; v < nodes; ++v)
+        renumber[v] = v;
+    for (uintf i = 0; i < junctions; ++i)
+        renumber[moved[i]+2] = i+2;
+    net.idx.permute(moved);
+
+    // lay the arcs out again in the new order of the vertices
+    graph.first.own();
+    graph.arcs.own();
+    std::vector<uint32_t> first(nodes+1, 0);
+    std::vector<arc> arcs(graph.arcs.size());
+    for (uintf w = 0; w < nodes; ++w) {
+        uintf v = REAL(w) && w-2 < junctions ? moved[w-2]+2 : w;
+        first[w+1] = first[w];
+        for (uint32_t i = graph.first[v]; i < graph.first[v+1]; ++i) {
+            arcs[first[w+1]++] = arc{ renumber[graph.arcs[i].to],
+                graph.arcs[i].edge };
+        }
+    }
+    graph.first.vec.swap(first);
+    graph.first.sync();
+    graph.arcs.vec.swap(arcs);
+    graph.arcs.sync();
+
+    net.edgenodes.own();
+    for (std::pair<uint32_t, uint32_t> &p : net.edgenodes.vec) {
+        p.first = renumber[p.first];
+        p.second = renumber[p.second];
+    }
+    net.edgenodes.sync();
+}
+
+#endif
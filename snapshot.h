@@ -0,0 +1,276 @@
+/* NETWORK SNAPSHOTS
+ * author: Zach Goldthorpe
+ *
+ * The file provides a binary image of the base network built by read_graph
+ * (the graph, the <u, v> pairs of every edge, the controller flags, the two
+ * ID tables and the controller ID's of the JSON, along with the block-cut tree
+ * index if it was built), so that
+ * repeated runs against the same network can skip the JSON altogether.
+ *
+ * A snapshot is a header followed by the arrays of the network, each starting
+ * on a 64-byte boundary and stored exactly as it is laid out in memory. Loading
+ * one therefore only maps the file read-only and points the arrays into the
+ * mapping; processes loading the same snapshot share its pages through the
+ * page cache. The header records a format version, the byte order of the
+ * machine that wrote it and a checksum of everything after it, and a snapshot
+ * that fails any of these checks is refused.
+ *
+ * save_snapshot: write the base network to a file
+ * load_snapshot: map a file as the base network
+ */
+
+#ifndef _snapshot_h_
+#define _snapshot_h_
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "read_graph.h"
+#include "bc_index.h"
+
+#define SNAPSHOT_MAGIC "GISCUPSN"
+#define SNAPSHOT_VERSION 4
+#define SNAPSHOT_ENDIAN 0x01020304
+#define SNAPSHOT_ALIGN 64
+
+/* writes the base network @net to the file @filename
+ *
+ * returns false if the file could not be written
+ */
+bool save_snapshot(const network &net, const char *filename);
+
+/* maps the snapshot @filename as the base network @net, which must be new, in
+ * place of read_graph; the mapping lasts as long as @net
+ *
+ * returns false (leaving the network untouched) if the file could not be
+ * mapped or is not a valid snapshot
+ */
+bool load_snapshot(network &net, const char *filename);
+
+
+// ==== DEFINITIONS ==== //
+
+// the arrays of a snapshot, in the order in which they are stored
+enum {
+    SEC_FIRST, SEC_ARCS, // graph
+    SEC_EDGEFIRST, SEC_EDGENODES, SEC_EDGEVTX, SEC_SPLITEDGE,
+    SEC_VSLOTS, SEC_VARENA, SEC_VOFFSET, // idx
+    SEC_ESLOTS, SEC_EARENA, SEC_EOFFSET, // edgeidx
+    SEC_CTRLNAMES, SEC_CTRLFIRST, // controller ID's
+    SEC_BCPARENT, SEC_BCDEPTH, SEC_BCCOMP, SEC_BCFIRST, SEC_BCVTX, // bcindex
+    SECTIONS
+};
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t version, endian;
+    uint64_t checksum; // of every byte after the header
+    uint64_t nodes, edges; // nodes and edges
+    struct {
+        uint64_t offset, length; // in bytes, from the start of the file
+    } section[SECTIONS];
+};
+
+/* a four-lane multiply-xorshift checksum of the @n bytes at @p, a multiple of
+ * 32 bytes
+ */
+static uint64_t snapshot_checksum(const char *p, size_t n) {
+    uint64_t lane[4] = { 1, 2, 3, 4 }, w;
+    for (size_t i = 0; i < n; i += 32) {
+        for (int k = 0; k < 4; ++k) {
+            memcpy(&w, p + i + 8*k, 8);
+            lane[k] = (lane[k] ^ w) * 0xBF58476D1CE4E5B9ULL;
+            lane[k] ^= lane[k] >> 31;
+        }
+    }
+    return (lane[0] ^ (lane[1] << 1)) ^ ((lane[2] << 2) ^ (lane[3] << 3)) ^ n;
+}
+
+/* the bytes of the arrays of the base network @net, in section order
+ */
+static void snapshot_sections(const network &net, const void *data[SECTIONS],
+        size_t length[SECTIONS]) {
+    #define SECTION(i, arr) \
+        data[i] = arr.data(), length[i] = arr.size() * sizeof(arr[0])
+    SECTION(SEC_FIRST, net.graph.first);
+    SECTION(SEC_ARCS, net.graph.arcs);
+    SECTION(SEC_EDGEFIRST, net.edgefirst);
+    SECTION(SEC_EDGENODES, net.edgenodes);
+    SECTION(SEC_EDGEVTX, net.edgevtx);
+    SECTION(SEC_SPLITEDGE, net.splitedge);
+    SECTION(SEC_VSLOTS, net.idx.slots);
+    SECTION(SEC_VARENA, net.idx.arena);
+    SECTION(SEC_VOFFSET, net.idx.offset);
+    SECTION(SEC_ESLOTS, net.edgeidx.slots);
+    SECTION(SEC_EARENA, net.edgeidx.arena);
+    SECTION(SEC_EOFFSET, net.edgeidx.offset);
+    SECTION(SEC_CTRLNAMES, net.ctrlnames);
+    SECTION(SEC_CTRLFIRST, net.ctrlfirst);
+    SECTION(SEC_BCPARENT, net.index.parent);
+    SECTION(SEC_BCDEPTH, net.index.depth);
+    SECTION(SEC_BCCOMP, net.index.comp);
+    SECTION(SEC_BCFIRST, net.index.blockfirst);
+    SECTION(SEC_BCVTX, net.index.blockvtx);
+    #undef SECTION
+}
+
+static inline size_t snapshot_align(size_t n) {
+    return (n + SNAPSHOT_ALIGN-1) & ~(size_t)(SNAPSHOT_ALIGN-1);
+}
+
+bool save_snapshot(const network &net, const char *filename) {
+    const void *data[SECTIONS];
+    size_t length[SECTIONS];
+    snapshot_sections(net, data, length);
+
+    snapshot_header head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, SNAPSHOT_MAGIC, 8);
+    head.version = SNAPSHOT_VERSION;
+    head.endian = SNAPSHOT_ENDIAN;
+    head.nodes = net.nodes;
+    head.edges = net.edges;
+    size_t pos = snapshot_align(sizeof(head));
+    for (int i = 0; i < SECTIONS; ++i) {
+        head.section[i].offset = pos;
+        head.section[i].length = length[i];
+        pos = snapshot_align(pos + length[i]);
+    }
+
+    // lay the body out in memory once, to checksum and write it
+    size_t start = head.section[0].offset;
+    std::vector<char> body(pos - start, 0);
+    for (int i = 0; i < SECTIONS; ++i) {
+        if (length[i])
+            memcpy(&body[head.section[i].offset - start], data[i], length[i]);
+    }
+    head.checksum = snapshot_checksum(body.data(), body.size());
+
+    FILE *out = fopen(filename, "wb");
+    if (!out)
+        return false;
+    char pad[SNAPSHOT_ALIGN] = {};
+    bool ok = fwrite(&head, sizeof(head), 1, out) == 1
+        && fwrite(pad, start - sizeof(head), 1, out) == 1
+        && fwrite(body.data(), body.size(), 1, out) == 1;
+    return fclose(out) == 0 && ok;
+}
+
+bool load_snapshot(network &net, const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(snapshot_header)) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    // shared, so that every process using the snapshot uses the same pages
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    const char *base = (const char *)map;
+    snapshot_header head;
+    memcpy(&head, base, sizeof(head));
+
+    // check the header, then that every section lies within the file
+    bool ok = !memcmp(head.magic, SNAPSHOT_MAGIC, 8)
+        && head.version == SNAPSHOT_VERSION && head.endian == SNAPSHOT_ENDIAN
+        && head.nodes >= 2 && head.nodes < UINT32_MAX
+        && head.edges < UINT32_MAX;
+    size_t start = snapshot_align(sizeof(head)), pos = start;
+    for (int i = 0; ok && i < SECTIONS; ++i) {
+        ok = head.section[i].offset == pos
+            && head.section[i].length <= size - pos;
+        pos = snapshot_align(pos + head.section[i].length);
+    }
+    ok = ok && pos == size
+        && snapshot_checksum(base + start, size - start) == head.checksum;
+
+    // the arrays must agree with each other and with the counts
+    auto count = [&](int i, size_t elem) -> size_t {
+        return head.section[i].length % elem ? SIZE_MAX
+            : head.section[i].length / elem;
+    };
+    auto last = [&](int i, size_t elem) -> size_t { // the last element
+        uint64_t x = 0;
+        memcpy(&x, base + head.section[i].offset + head.section[i].length
+            - elem, elem);
+        return x;
+    };
+    size_t vslots = count(SEC_VSLOTS, sizeof(id_table::slot));
+    size_t eslots = count(SEC_ESLOTS, sizeof(id_table::slot));
+    size_t vkeys = count(SEC_VOFFSET, 8), ekeys = count(SEC_EOFFSET, 8);
+    ok = ok && count(SEC_FIRST, 4) == head.nodes + 1
+        && last(SEC_FIRST, 4) == count(SEC_ARCS, sizeof(arc))
+        && count(SEC_EDGEFIRST, 4) == head.edges + 1
+        && last(SEC_EDGEFIRST, 4) == count(SEC_EDGENODES, 8)
+        && count(SEC_EDGEVTX, 4) == head.edges
+        && vkeys != SIZE_MAX && vkeys >= 1 && ekeys == head.edges + 1
+        && last(SEC_VOFFSET, 8) == head.section[SEC_VARENA].length
+        && last(SEC_EOFFSET, 8) == head.section[SEC_EARENA].length
+        && count(SEC_SPLITEDGE, 4) == head.nodes - 1 - vkeys
+        && vslots != SIZE_MAX && !(vslots & (vslots-1))
+        && vslots >= 2*(vkeys-1)
+        && eslots != SIZE_MAX && !(eslots & (eslots-1))
+        && eslots >= 2*(ekeys-1);
+    // the controller ID's are either missing altogether or complete
+    size_t ctrls = count(SEC_CTRLFIRST, 8);
+    ok = ok && (ctrls == 0 ? head.section[SEC_CTRLNAMES].length == 0
+        : ctrls != SIZE_MAX
+            && last(SEC_CTRLFIRST, 8) == head.section[SEC_CTRLNAMES].length);
+    // the index is either missing altogether or complete
+    size_t bcnodes = count(SEC_BCPARENT, 4);
+    size_t bcvertices = vkeys + 1 + count(SEC_EDGENODES, 8);
+    ok = ok && (bcnodes == 0 ? head.section[SEC_BCDEPTH].length == 0
+            && head.section[SEC_BCCOMP].length == 0
+            && head.section[SEC_BCFIRST].length == 0
+            && head.section[SEC_BCVTX].length == 0
+        : bcnodes != SIZE_MAX && bcnodes >= bcvertices
+            && count(SEC_BCDEPTH, 4) == bcnodes
+            && count(SEC_BCCOMP, 4) == bcnodes
+            && count(SEC_BCFIRST, 4) == bcnodes - bcvertices + 1
+            && last(SEC_BCFIRST, 4) == count(SEC_BCVTX, 4));
+    if (!ok) {
+        munmap(map, size);
+        return false;
+    }
+
+    #define SECTION(i, arr) \
+        arr.borrow((decltype(arr.data()))(base + head.section[i].offset), \
+            head.section[i].length / sizeof(arr[0]))
+    SECTION(SEC_FIRST, net.graph.first);
+    SECTION(SEC_ARCS, net.graph.arcs);
+    SECTION(SEC_EDGEFIRST, net.edgefirst);
+    SECTION(SEC_EDGENODES, net.edgenodes);
+    SECTION(SEC_EDGEVTX, net.edgevtx);
+    SECTION(SEC_SPLITEDGE, net.splitedge);
+    SECTION(SEC_VSLOTS, net.idx.slots);
+    SECTION(SEC_VARENA, net.idx.arena);
+    SECTION(SEC_VOFFSET, net.idx.offset);
+    SECTION(SEC_ESLOTS, net.edgeidx.slots);
+    SECTION(SEC_EARENA, net.edgeidx.arena);
+    SECTION(SEC_EOFFSET, net.edgeidx.offset);
+    SECTION(SEC_CTRLNAMES, net.ctrlnames);
+    SECTION(SEC_CTRLFIRST, net.ctrlfirst);
+    SECTION(SEC_BCPARENT, net.index.parent);
+    SECTION(SEC_BCDEPTH, net.index.depth);
+    SECTION(SEC_BCCOMP, net.index.comp);
+    SECTION(SEC_BCFIRST, net.index.blockfirst);
+    SECTION(SEC_BCVTX, net.index.blockvtx);
+    #undef SECTION
+    net.index.real = vkeys + 1;
+    net.index.vertices = bcvertices;
+    net.nodes = head.nodes;
+    net.edges = head.edges;
+    net.mapping = map;
+    net.maplen = size;
+    return true;
+}
+
+#endif
@@ -0,0 +1,119 @@
+/* SINGLE-PRODUCER SINGLE-CONSUMER RING
+ * author: Zach Goldthorpe
+ *
+ * The file provides the lock-free ring passing work from one thread to
+ * another [see read_graph.h, where the rows read by one thread are added to
+ * the graph by another]. The ring holds a fixed number of slots, which are
+ * filled in place by the producer and emptied in place by the consumer, so
+ * that nothing is allocated or copied once the slots have reached their
+ * working size. Each side only writes its own index, and only waits when the
+ * ring is full (the producer) or empty (the consumer), by yielding its core.
+ *
+ * spsc_ring::claim:  the free slot the producer fills next
+ * spsc_ring::push:   hand the claimed slot to the consumer
+ * spsc_ring::close:  mark that nothing more will be pushed
+ * spsc_ring::oldest: the oldest slot the consumer has not emptied yet
+ * spsc_ring::front:  the slot the consumer empties next
+ * spsc_ring::pop:    hand the front slot back to the producer
+ */
+
+#ifndef _spsc_h_
+#define _spsc_h_
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+template<typename T>
+struct spsc_ring {
+    explicit spsc_ring(size_t slots) : slot(slots) {}
+
+    /* (producer) waits until a slot is free
+     *
+     * returns the slot, to be filled and pushed
+     */
+    T &claim();
+
+    /* (producer) hands the slot last claimed to the consumer
+     */
+    void push();
+
+    /* (producer) marks that nothing more will be pushed, so that front
+     * returns nullptr once the ring is empty
+     */
+    void close();
+
+    /* (producer) returns the oldest slot pushed but not yet popped, or
+     * nullptr if there is none
+     */
+    const T *oldest() const;
+
+    /* (consumer) waits until a slot is pushed or the ring is closed
+     *
+     * returns the slot, or nullptr if the ring is closed and empty
+     */
+    T *front();
+
+    /* (consumer) hands the front slot back to the producer
+     */
+    void pop();
+
+private:
+    std::vector<T> slot;
+    // the slots pushed and popped so far; slot i lives at slot[i % size]
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    std::atomic<bool> closed{false};
+};
+
+
+// ==== DEFINITIONS ==== //
+
+template<typename T>
+T &spsc_ring<T>::claim() {
+    size_t h = head.load(std::memory_order_relaxed);
+    while (h - tail.load(std::memory_order_acquire) == slot.size())
+        std::this_thread::yield();
+    return slot[h % slot.size()];
+}
+
+template<typename T>
+void spsc_ring<T>::push() {
+    head.store(head.load(std::memory_order_relaxed) + 1,
+        std::memory_order_release);
+}
+
+template<typename T>
+void spsc_ring<T>::close() {
+    closed.store(true, std::memory_order_release);
+}
+
+template<typename T>
+const T *spsc_ring<T>::oldest() const {
+    size_t t = tail.load(std::memory_order_acquire);
+    if (t == head.load(std::memory_order_relaxed))
+        return nullptr;
+    return &slot[t % slot.size()];
+}
+
+template<typename T>
+T *spsc_ring<T>::front() {
+    size_t t = tail.load(std::memory_order_relaxed);
+    for (;;) {
+        if (head.load(std::memory_order_acquire) != t)
+            return &slot[t % slot.size()];
+        // a push before the close is seen once the close is
+        if (closed.load(std::memory_order_acquire)
+                && head.load(std::memory_order_acquire) == t)
+            return nullptr;
+        std::this_thread::yield();
+    }
+}
+
+template<typename T>
+void spsc_ring<T>::pop() {
+    tail.store(tail.load(std::memory_order_relaxed) + 1,
+        std::memory_order_release);
+}
+
+#endif
@@ -0,0 +1,144 @@
+/* RUN STATISTICS
+ * author: Zach Goldthorpe
+ *
+ * The file provides the timers and counters of a run, reported with --stats.
+ * They are always kept, as keeping them costs a clock read at either end of
+ * every phase and counters bumped outside of the inner loops. The probes of
+ * the ID tables are counted once per insertion, from where the probing stopped
+ * [see id_table.h]. The one counter that would sit in an inner loop, the depth
+ * of the DFS stack, is only followed by queries made to count it (as --stats
+ * does), with traverse() compiled apart for them [see traverse.h]; otherwise
+ * it is reported as 0.
+ *
+ * The phases are, in order: parsing the rows, parsing the controllers, laying
+ * the network out, attaching the starting points, finding the biconnected
+ * components (traverse(), par_traverse() or the index), and the output sweep
+ * writing the features.
+ *
+ * The statistics of building a network are kept with the network, and those
+ * of a query with the query [see network.h, traverse.h].
+ *
+ * stat_clock:   read the clock at the start of a phase
+ * stat_phase:   charge the time since the clock to a phase
+ * stats_add:    add the statistics of one run to another
+ * stats_report: write the statistics to a stream, as text or json
+ */
+
+#ifndef _stats_h_
+#define _stats_h_
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <sys/resource.h>
+
+enum {
+    PH_ROWS, PH_CONTROLLERS, PH_LAYOUT, PH_STARTINGPOINTS, PH_DFS, PH_OUTPUT,
+    PHASES
+};
+
+struct run_stats {
+    double phase[PHASES] = {}; // the wall time of each phase, in seconds
+    uint64_t bytes = 0; // the bytes of JSON read
+    uint64_t rows = 0; // the rows read
+    uint64_t vertices = 0, edges = 0; // the size of the network
+    uint64_t split = 0; // the vertices made from edges by reduction 1
+    uint64_t probes = 0; // the slots of the ID tables probed while building
+    uint64_t collisions = 0; // the ID's sharing a fingerprint hash (low memory)
+    uint64_t depth = 0; // the deepest the DFS stack (BFS tree) went
+    uint64_t blocks = 0; // the biconnected components found by the query
+    // the vertices pruned in trees and collapsed into chains by the
+    // contraction [see contract.h]
+    uint64_t pruned = 0, chained = 0;
+};
+
+using stat_time = std::chrono::steady_clock::time_point;
+
+/* returns the time at which a phase starts
+ */
+static inline stat_time stat_clock();
+
+/* adds the time since @start to the phase @ph of @st, and restarts @start so
+ * that the next phase may follow on directly
+ */
+static inline void stat_phase(run_stats &st, int ph, stat_time &start);
+
+/* adds every time and counter of @from to those of @into (the greatest depth
+ * is kept instead)
+ */
+static inline void stats_add(run_stats &into, const run_stats &from);
+
+/* writes the statistics @st to @out, as "name: value" lines or, if @json is
+ * set, as a single json object
+ */
+inline void stats_report(const run_stats &st, FILE *out, bool json);
+
+
+// ==== DEFINITIONS ==== //
+
+static inline stat_time stat_clock() {
+    return std::chrono::steady_clock::now();
+}
+
+static inline void stat_phase(run_stats &st, int ph, stat_time &start) {
+    stat_time now = std::chrono::steady_clock::now();
+    st.phase[ph] += std::chrono::duration<double>(now - start).count();
+    start = now;
+}
+
+static inline void stats_add(run_stats &into, const run_stats &from) {
+    for (int ph = 0; ph < PHASES; ++ph)
+        into.phase[ph] += from.phase[ph];
+    into.bytes += from.bytes;
+    into.rows += from.rows;
+    into.vertices += from.vertices;
+    into.edges += from.edges;
+    into.split += from.split;
+    into.probes += from.probes;
+    into.collisions += from.collisions;
+    into.depth = into.depth > from.depth ? into.depth : from.depth;
+    into.blocks += from.blocks;
+    into.pruned += from.pruned;
+    into.chained += from.chained;
+}
+
+inline void stats_report(const run_stats &st, FILE *out, bool json) {
+    static const char *const phases[PHASES] = {
+        "parse_rows", "parse_controllers", "layout", "starting_points", "dfs",
+        "output"
+    };
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    const struct { const char *name; uint64_t value; } counters[] = {
+        { "bytes_read", st.bytes }, { "rows", st.rows },
+        { "vertices", st.vertices }, { "edges", st.edges },
+        { "split_vertices", st.split }, { "hash_probes", st.probes },
+        { "hash_collisions", st.collisions },
+        { "max_dfs_depth", st.depth }, { "blocks", st.blocks },
+        { "pruned_vertices", st.pruned }, { "chain_vertices", st.chained },
+        { "peak_rss_kb", (uint64_t)usage.ru_maxrss }
+    };
+    double total = 0;
+    for (double t : st.phase)
+        total += t;
+    if (!json) {
+        for (int ph = 0; ph < PHASES; ++ph)
+            fprintf(out, "%s: %.6f s\n", phases[ph], st.phase[ph]);
+        fprintf(out, "total: %.6f s\n", total);
+        for (const auto &c : counters)
+            fprintf(out, "%s: %llu\n", c.name, (unsigned long long)c.value);
+        return;
+    }
+    fprintf(out, "{\"phases\": {");
+    for (int ph = 0; ph < PHASES; ++ph)
+        fprintf(out, "\"%s\": %.6f, ", phases[ph], st.phase[ph]);
+    fprintf(out, "\"total\": %.6f}, \"counters\": {", total);
+    bool first = true;
+    for (const auto &c : counters) {
+        fprintf(out, "%s\"%s\": %llu", first ? "" : ", ", c.name,
+            (unsigned long long)c.value);
+        first = false;
+    }
+    fprintf(out, "}}\n");
+}
+
+#endif
@@ -0,0 +1,124 @@
+#!/bin/sh
+# Differential tests
+# author: Zach Goldthorpe
+#
+# Generates small random networks with gen_case [see test/gen_case.cpp] and
+# checks every mode of the program against the serial run of the robust reader
+# on the same network: the fast reader (also falling back on the robust one
+# for rows whose keys are out of order), -j, --pipeline, --parallel,
+# --contract, --reorder and --index, then --edits against the serial run on
+# the edited network, and --attribute against one serial run per starting
+# point. The upstream features are compared as sets, so the modes may write
+# them in any order, but each only once.
+#
+# SEEDS sets the number of networks, and FIRST the seed of the first one; a
+# failing case is kept in test/failed/<seed> to be run again by hand.
+#
+# usage: [SEEDS=200] [FIRST=1] sh test/fuzz.sh
+
+SEEDS=${SEEDS:-200}
+FIRST=${FIRST:-1}
+
+LC_ALL=C
+export LC_ALL
+dir=$(cd "$(dirname "$0")" && pwd)
+fast=$dir/giscup-fast
+robust=$dir/giscup-robust
+out=${TMPDIR:-/tmp}/giscup-fuzz.$$
+mkdir -p "$out" || exit 1
+trap 'rm -rf "$out"' EXIT
+
+failed=0
+seed=$FIRST
+while [ $seed -lt $((FIRST + SEEDS)) ]; do
+    case=$out/case
+    rm -rf "$case"
+    mkdir -p "$case"
+    "$dir/gen_case" "$case" $seed || exit 1
+    bad=""
+
+    # runs the program with the given arguments, then the JSON and starting
+    # points files, into $out/answer.txt sorted
+    run() {
+        "$@" "$out/answer.txt" 2> "$out/log.txt" \
+            && sort "$out/answer.txt" > "$out/sorted.txt"
+    }
+    # checks the last run against $1, naming the mode $2
+    check() {
+        if [ $? -ne 0 ] || ! cmp -s "$out/sorted.txt" "$1"; then
+            bad="$bad $2"
+        fi
+    }
+
+    # the upstream features of the network before and after the edits
+    run "$robust" "$case/data.json" "$case/startingpoints.txt" || exit 1
+    mv "$out/sorted.txt" "$out/expected.txt"
+    run "$robust" "$case/edited.json" "$case/startingpoints.txt" || exit 1
+    mv "$out/sorted.txt" "$out/edited.txt"
+    sp="$case/startingpoints.txt"
+
+    run "$fast" "$case/data.json" "$sp"; check "$out/expected.txt" fast
+    run "$fast" "$case/shuffled.json" "$sp"
+    check "$out/expected.txt" fallback
+    run "$robust" "$case/shuffled.json" "$sp"
+    check "$out/expected.txt" robust-shuffled
+    run "$fast" -j 3 "$case/shuffled.json" "$sp"; check "$out/expected.txt" -j
+    run "$fast" --pipeline "$case/shuffled.json" "$sp"
+    check "$out/expected.txt" pipeline
+    run "$fast" -j 2 --parallel "$case/data.json" "$sp"
+    check "$out/expected.txt" parallel
+    run "$fast" --contract "$case/data.json" "$sp"
+    check "$out/expected.txt" contract
+    run "$fast" -j 2 --parallel --contract "$case/data.json" "$sp"
+    check "$out/expected.txt" parallel-contract
+    run "$fast" --reorder dfs "$case/data.json" "$sp"
+    check "$out/expected.txt" reorder
+    run "$fast" --index "$case/data.json" "$sp"; check "$out/expected.txt" index
+    run "$fast" --index --edits "$case/edits.txt" "$case/data.json" "$sp"
+    check "$out/edited.txt" edits
+    "$fast" --save-snapshot "$out/network.snap" "$case/data.json" \
+        2> "$out/log.txt" \
+        && run "$fast" --index --edits "$case/edits.txt" \
+            --load-snapshot "$out/network.snap" "$sp"
+    check "$out/edited.txt" snapshot-edits
+
+    # each starting point on its own, as <starting point, feature> pairs
+    for json in data edited; do
+        : > "$out/pairs-$json.txt"
+        while IFS= read -r id; do
+            printf '%s\n' "$id" > "$out/one.txt"
+            "$robust" "$case/$json.json" "$out/one.txt" "$out/answer.txt" \
+                2> "$out/log.txt" || exit 1
+            awk -v id="$id" '{ print id "\t" $0 }' "$out/answer.txt" \
+                >> "$out/pairs-$json.txt"
+        done < "$sp"
+        sort -o "$out/pairs-$json.txt" "$out/pairs-$json.txt"
+    done
+    by_start='NF == 0 { id = ""; next } id == "" { id = $0; next }
+        { print id "\t" $0 }'
+    by_feature='{ for (i = 2; i <= NF; ++i) print $i "\t" $1 }'
+    run "$fast" --attribute "$case/data.json" "$sp" \
+        && awk "$by_start" "$out/answer.txt" | sort > "$out/sorted.txt"
+    check "$out/pairs-data.txt" attribute
+    run "$fast" --attribute=features "$case/data.json" "$sp" \
+        && awk -F '\t' "$by_feature" "$out/answer.txt" | sort \
+            > "$out/sorted.txt"
+    check "$out/pairs-data.txt" attribute-features
+    run "$fast" --attribute --edits "$case/edits.txt" "$case/data.json" "$sp" \
+        && awk "$by_start" "$out/answer.txt" | sort > "$out/sorted.txt"
+    check "$out/pairs-edited.txt" attribute-edits
+
+    if [ -n "$bad" ]; then
+        echo "FAIL seed $seed:$bad" >&2
+        mkdir -p "$dir/failed"
+        rm -rf "$dir/failed/$seed"
+        cp -r "$case" "$dir/failed/$seed"
+        failed=$((failed+1))
+    fi
+    seed=$((seed+1))
+done
+if [ $failed -ne 0 ]; then
+    echo "$failed of $SEEDS random networks failed" >&2
+    exit 1
+fi
+echo "$SEEDS random networks passed"
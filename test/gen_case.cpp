@@ -0,0 +1,207 @@
+/* Random Test Case Generator
+ * author: Zach Goldthorpe
+ *
+ * Writes a small random network in the GIS Cup format, with starting points and
+ * edits, for the differential tests [see test/fuzz.sh]. The networks are kept
+ * small enough that every mode can be checked against the serial run of the
+ * robust reader, but are drawn to hit the corners the modes handle apart: edges
+ * with several <from, to> pairs, self-loops, repeated rows, junction and edge
+ * controllers, controllers and starting points the rows do not name, and
+ * braced GUID's among the plain ID's.
+ *
+ * The files written to the output directory are:
+ *  data.json:          the network, its rows with their keys in order
+ *  shuffled.json:      the same network, with the keys of the rows from some
+ *                      row onwards in a random order (for the fast reader to
+ *                      fall back on the robust one)
+ *  startingpoints.txt: the starting points, each once
+ *  edits.txt:          edits to the network [see bc_edit.h]
+ *  edited.json:        the network with the edits applied
+ *
+ * usage: gen_case <dir> <seed>
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+static uint64_t state = 1;
+
+/* the next number of the random stream, below @n
+ */
+static uint64_t rnd(uint64_t n) {
+    uint64_t x = (state += 0x9E3779B97F4A7C15ULL);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return (x ^ (x >> 31)) % n;
+}
+
+/* the ID of junction @v (resp. edge @e), a braced GUID for some of them
+ */
+static string vertex_id(uint64_t v) {
+    char buf[48];
+    if (v % 4 == 3)
+        snprintf(buf, sizeof buf, "{5A1E0C3D-7E21-4A0D-8F55-%012llX}",
+            (unsigned long long)v);
+    else
+        snprintf(buf, sizeof buf, "v%llu", (unsigned long long)v);
+    return buf;
+}
+static string edge_id(uint64_t e) {
+    char buf[48];
+    if (e % 5 == 4)
+        snprintf(buf, sizeof buf, "{0B9D44A2-0C4F-4B2E-9D3A-%012llX}",
+            (unsigned long long)e);
+    else
+        snprintf(buf, sizeof buf, "e%llu", (unsigned long long)e);
+    return buf;
+}
+
+struct row {
+    string via, from, to;
+};
+
+/* the ID of a junction (resp. edge) of the @n there are, or now and then one
+ * past them
+ */
+static string any_vertex(uint64_t n) {
+    return vertex_id(rnd(n + 1));
+}
+static string any_edge(uint64_t n) {
+    return edge_id(rnd(n + 1));
+}
+
+/* a feature named by @rows, or now and then one they do not name
+ */
+static string any_feature(const vector<row> &rows, uint64_t vertices,
+        uint64_t edges) {
+    if (rows.empty() || !rnd(6))
+        return rnd(2) ? any_vertex(vertices) : any_edge(edges);
+    const row &r = rows[rnd(rows.size())];
+    return rnd(3) == 0 ? r.via : rnd(2) ? r.from : r.to;
+}
+
+/* writes the network of @rows and @ctrls to @filename, the keys of each row
+ * from row @shuffle onwards in a random order and with a key of their own
+ */
+static bool write_json(const char *filename, const vector<row> &rows,
+        const vector<string> &ctrls, size_t shuffle) {
+    FILE *out = fopen(filename, "w");
+    if (!out)
+        return false;
+    string list = "\"controllers\": [";
+    for (size_t i = 0; i < ctrls.size(); ++i)
+        list += (i ? ", {\"globalId\": \"" : "{\"globalId\": \"") + ctrls[i]
+            + "\"}";
+    list += "]";
+    bool first = rnd(3) == 0;
+    fprintf(out, "{");
+    if (rnd(3) == 0)
+        fprintf(out, "\"junk\": {\"rows\": [1], \"controllers\": 2}, ");
+    if (first)
+        fprintf(out, "%s, ", list.c_str());
+    fprintf(out, "\"rows\": [\n");
+    for (size_t k = 0; k < rows.size(); ++k) {
+        string field[4] = {
+            "\"viaGlobalId\": \"" + rows[k].via + "\"",
+            "\"fromGlobalId\": \"" + rows[k].from + "\"",
+            "\"toGlobalId\": \"" + rows[k].to + "\"",
+            "\"toTerminalId\": " + to_string(k)
+        };
+        int keys = 3;
+        if (k >= shuffle) {
+            keys = 4;
+            for (int i = 3; i > 0; --i)
+                swap(field[i], field[rnd(i+1)]);
+        }
+        fprintf(out, "{");
+        for (int i = 0; i < keys; ++i)
+            fprintf(out, "%s%s", i ? ", " : "", field[i].c_str());
+        fprintf(out, "}%s", k + 1 < rows.size() ? ",\n" : "\n");
+    }
+    fprintf(out, "]%s%s}\n", first ? "" : ", ", first ? "" : list.c_str());
+    bool ok = !ferror(out);
+    return fclose(out) == 0 && ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <dir> <seed>\n", argv[0]);
+        return 1;
+    }
+    string dir = argv[1];
+    state = strtoull(argv[2], nullptr, 10);
+    uint64_t vertices = 2 + rnd(10), edges = 0;
+
+    // the rows: mostly a new edge, sometimes another pair of an earlier one
+    vector<row> rows(1 + rnd(2*vertices));
+    for (size_t k = 0; k < rows.size(); ++k) {
+        uint64_t e = k && !rnd(6) ? rnd(edges) : edges++;
+        uint64_t u = rnd(vertices), v = rnd(8) ? rnd(vertices) : u;
+        rows[k] = row{ edge_id(e), vertex_id(u), vertex_id(v) };
+        if (k && !rnd(12))
+            rows[k] = rows[rnd(k)];
+    }
+    vector<string> ctrls;
+    for (size_t i = 1 + rnd(3); i > 0; --i)
+        ctrls.push_back(any_feature(rows, vertices, edges));
+    vector<string> starts;
+    for (size_t i = 1 + rnd(4); i > 0; --i) {
+        string id = any_feature(rows, vertices, edges);
+        if (find(starts.begin(), starts.end(), id) == starts.end())
+            starts.push_back(id);
+    }
+
+    bool ok = write_json((dir + "/data.json").c_str(), rows, ctrls,
+            rows.size())
+        && write_json((dir + "/shuffled.json").c_str(), rows, ctrls,
+            rnd(rows.size()));
+    FILE *sp = fopen((dir + "/startingpoints.txt").c_str(), "w");
+    FILE *ed = fopen((dir + "/edits.txt").c_str(), "w");
+    if (!ok || !sp || !ed) {
+        fprintf(stderr, "%s: cannot write the output files\n", argv[0]);
+        return 1;
+    }
+    for (const string &id : starts)
+        fprintf(sp, "%s\n", id.c_str());
+
+    // the edits, applied to the rows and controllers as they go
+    for (size_t i = rnd(6); i > 0; --i) {
+        uint64_t op = rnd(4);
+        if (op == 0 || (op == 1 && rows.empty())) {
+            row r{ any_edge(edges), any_vertex(vertices),
+                any_vertex(vertices) };
+            if (!rows.empty() && rnd(3) == 0)
+                r.via = rows[rnd(rows.size())].via;
+            rows.push_back(r);
+            fprintf(ed, "add-row %s %s %s\n", r.via.c_str(), r.from.c_str(),
+                r.to.c_str());
+        } else if (op == 1) {
+            // either way round, the rows being undirected
+            size_t k = rnd(rows.size());
+            bool flip = rnd(3) == 0;
+            fprintf(ed, "remove-row %s %s %s\n", rows[k].via.c_str(),
+                (flip ? rows[k].to : rows[k].from).c_str(),
+                (flip ? rows[k].from : rows[k].to).c_str());
+            rows.erase(rows.begin() + k);
+        } else if (op == 2 || ctrls.empty()) {
+            ctrls.push_back(any_feature(rows, vertices, edges));
+            fprintf(ed, "add-controller %s\n", ctrls.back().c_str());
+        } else {
+            string id = ctrls[rnd(ctrls.size())];
+            ctrls.erase(remove(ctrls.begin(), ctrls.end(), id), ctrls.end());
+            fprintf(ed, "remove-controller %s\n", id.c_str());
+        }
+    }
+    ok = !ferror(sp) && !ferror(ed);
+    ok &= fclose(sp) == 0;
+    ok &= fclose(ed) == 0;
+    ok = write_json((dir + "/edited.json").c_str(), rows, ctrls, rows.size())
+        && ok;
+    return ok ? 0 : 1;
+}
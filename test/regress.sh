@@ -0,0 +1,56 @@
+#!/bin/sh
+# Regression cases
+# author: Zach Goldthorpe
+#
+# Runs every case of test/cases through both readers and checks the upstream
+# features against the expected ones. A case is a directory holding
+#     data.json           the network
+#     startingpoints.txt  the starting points
+#     expected.txt        the upstream features, sorted
+#     args                the options of the run (optional), with any files
+#                         they name relative to the case
+# and is run once straight from the JSON and once from a snapshot of it.
+#
+# usage: sh test/regress.sh
+
+LC_ALL=C
+export LC_ALL
+dir=$(dirname "$0")
+out=${TMPDIR:-/tmp}/giscup-regress.$$
+mkdir -p "$out" || exit 1
+trap 'rm -rf "$out"' EXIT
+
+failed=0
+for case in "$dir"/cases/*/; do
+    name=$(basename "$case")
+    args=$(cat "$case/args" 2>/dev/null)
+    for reader in fast robust; do
+        prog=$(cd "$dir" && pwd)/giscup-$reader
+        for from in json snapshot; do
+            if [ $from = json ]; then
+                (cd "$case" && "$prog" $args data.json startingpoints.txt \
+                    "$out/answer.txt") 2> "$out/log.txt"
+            else
+                "$prog" --save-snapshot "$out/network.snap" "$case/data.json" \
+                    2> "$out/log.txt" \
+                && (cd "$case" && "$prog" $args \
+                    --load-snapshot "$out/network.snap" startingpoints.txt \
+                    "$out/answer.txt") 2>> "$out/log.txt"
+            fi
+            if [ $? -ne 0 ]; then
+                echo "FAIL $name ($reader, $from): exited with an error" >&2
+                cat "$out/log.txt" >&2
+                failed=$((failed+1))
+            elif ! sort "$out/answer.txt" | cmp -s - "$case/expected.txt"; then
+                echo "FAIL $name ($reader, $from): unexpected features" >&2
+                sort "$out/answer.txt" | diff "$case/expected.txt" - >&2
+                failed=$((failed+1))
+            fi
+        done
+    done
+done
+if [ $failed -ne 0 ]; then
+    echo "$failed regression runs failed" >&2
+    exit 1
+fi
+echo "regression cases passed"
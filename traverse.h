@@ -0,0 +1,486 @@
+/* TRAVERSAL
+ * author: Zach Goldthorpe
+ *
+ * The file provides the two engines finding the upstream vertices of a query
+ * [see upstream_features.cpp for the problem and its reductions].
+ *
+ * traverse() is the original serial DFS, finding the biconnected components
+ * and the ones on the path from HEAD to TAIL in a single sweep.
+ *
+ * par_traverse() finds the same components with the algorithm of Tarjan and
+ * Vishkin, every step of which runs on several threads:
+ *  1. a spanning tree of the component of TAIL is grown from TAIL by a
+ *     level-synchronous BFS, the threads claiming vertices by compare-and-swap;
+ *  2. subtree sizes are summed bottom-up and preorder numbers handed out
+ *     top-down, one BFS level at a time, so that the subtree of v is numbered
+ *     pre[v]..pre[v]+size[v]-1;
+ *  3. low[v] and high[v], the least and greatest number adjacent to the subtree
+ *     of v, are aggregated bottom-up in the same way;
+ *  4. every tree edge (named by its child) is unioned with the tree edge above
+ *     it when the subtree below escapes the subtree above (low[v] < pre[p] or
+ *     high[v] >= pre[p]+size[p]), and with the tree edge of the other end of
+ *     every non-tree edge joining two unrelated vertices; the sets of this
+ *     lock-free union-find are then the biconnected components.
+ * Levels too narrow to be worth a barrier are handled by one thread alone.
+ * A simple path from HEAD to TAIL passes through exactly the components on the
+ * path between them in the block-cut tree, and the tree path is such a path,
+ * so those are the components of its edges. As traverse() also marks every
+ * component holding TAIL once TAIL is reached, so are those of the tree edges
+ * leaving TAIL.
+ *
+ * Either way, the output sweep of answer() writes the same features (it needs
+ * dfs[v].first nonzero for the upstream vertices).
+ *
+ * traverse:     find the upstream vertices with a serial DFS
+ * par_traverse: find the upstream vertices on several threads
+ */
+
+#ifndef _traverse_h_
+#define _traverse_h_
+#include <cstdint>
+#include <vector>
+#include <stack>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include "read_graph.h"
+#include "output.h"
+#include "stats.h"
+
+/* the state of one query, kept apart from the network (which every query only
+ * reads) so that several queries can run at once
+ */
+struct query {
+    // ov lays the starting points over the network @ov.net [see read_graph.h]
+    overlay ov;
+    // upstream[v] indicates that vertex v is an upstream feature
+    std::vector<bool> upstream;
+    // dfs[v] stores <dfs_count, dfs_low> pairs for the DFS that finds
+    // articulation points (step 1)
+    std::vector<uintp> dfs;
+    // the threads par_traverse() runs on, or 0 to use traverse()
+    uintf threads = 0;
+    // the deepest the DFS stack went (for par_traverse(), the depth of the
+    // spanning tree) and the biconnected components found, for --stats [see
+    // stats.h]; traverse() only finds the components reachable from HEAD, and
+    // par_traverse() those reachable from TAIL. traverse() only follows the
+    // depth of its stack if @track_depth is set, leaving it 0 otherwise
+    uintf depth = 0, blocks = 0;
+    bool track_depth = false;
+    // starts and up hold the vertices of the index [see bc_index.h] for the
+    // queries answered through it
+    std::vector<uint32_t> starts, up;
+    // out writes the features found [see output.h], stats accumulates the
+    // phases and counters of every query answered with this state, and
+    // elapsed is the time the last one spent finding the components
+    feature_out out;
+    run_stats stats;
+    double elapsed = 0;
+};
+
+/* traverse through the constructed graph in a non-recursive DFS to find the
+ * biconnected components which lie along the path from HEAD to TAIL, recording
+ * the info into "upstream" of the query @q
+ */
+void traverse(query &q);
+
+/* finds the same components as traverse() on @q.threads threads, recording
+ * the info into "upstream" (and "dfs") of the query @q
+ */
+void par_traverse(query &q);
+
+
+// ==== DEFINITIONS ==== //
+
+/* traverse() itself, following the depth of the DFS stack only if @DEPTH is
+ * set, so that the loop does not pay for it otherwise
+ */
+template<bool DEPTH>
+static void traverse_dfs(query &q) {
+    std::vector<bool> &upstream = q.upstream;
+    std::vector<uintp> &dfs = q.dfs;
+    // struct representing the recursion stack frame for the original DFS
+    struct frame {
+        // @v denotes the vertex of the DFS
+        // @i denotes the arc it last checked, and @end the end of its arcs
+        // @best stores the best value of dfs_count encountered [see @dfs]
+        // @reached stores if @v can reach TAIL in the DFS
+        // @started stores if any edge has been explored yet
+        uintf v;
+        const arc *i, *end;
+        uintf best;
+        bool reached, started;
+        frame(const overlay &ov, uintf v, uintf best, bool reached,
+                bool started)
+            : v(v), best(best), reached(reached), started(started) {
+            neighbours(ov, v, i, end);
+        }
+    };
+    // count tracks dfs_count for the entire recursion
+    uintf count = 1;
+    // acc accumulates vertices during the DFS until a biconnected component is
+    // fully realised
+    std::stack<uintf> acc;
+    // stk serves as the substitute for the recursion stack
+    std::stack<frame> stk;
+    stk.emplace(q.ov, HEAD, count++, false, false);
+    // child_reached will store the return value of the recursive call
+    bool child_reached = false;
+    q.depth = DEPTH ? 1 : 0;
+    q.blocks = 0;
+
+    while (!stk.empty()) {
+        frame fm = stk.top();
+        stk.pop();
+        fm.reached |= child_reached; // fetch return value
+        if (fm.started) {
+            // we have already seen at least one edge, so check for a
+            // biconnected component
+            uintf u = fm.i->to;
+            if (dfs[u].second >= dfs[fm.v].first) {
+                // we have found an articulation point
+                while (acc.top() != u) {
+                    // this biconnected component is upstream
+                    upstream[acc.top()] = upstream[acc.top()]|child_reached;
+                    acc.pop();
+                }
+                upstream[u] = upstream[u]|child_reached;
+                acc.pop();
+                ++q.blocks;
+            } else fm.best = std::min(fm.best, dfs[u].second);
+
+            ++fm.i; // examine next edge
+        } else {
+            // otherwise, we have seen this vertex for the first time
+            dfs[fm.v] = std::make_pair(fm.best, fm.best);
+            acc.push(fm.v);
+        }
+        while (fm.i != fm.end && dfs[fm.i->to].first > 0) {
+            // skip the edges that have already been recursed (those deleted
+            // by reduction 1 are not in the graph at all)
+            // check if we can reach TAIL but otherwise fetch already obtained
+            // information
+            fm.reached |= fm.i->to == TAIL;
+            fm.best = std::min(fm.best, dfs[fm.i->to].second);
+            ++fm.i;
+        }
+        if (fm.i == fm.end) {
+            // we have exhausted the edges of this vertex
+            dfs[fm.v].second = fm.best;
+            child_reached = fm.reached;
+            continue;
+        }
+        // recurse through edge fm.i
+        uintf u = fm.i->to;
+        fm.reached |= u == TAIL;
+        fm.started = 1;
+        stk.push(fm);
+        stk.emplace(q.ov, u, count++, false, false);
+        if (DEPTH)
+            q.depth = std::max<uintf>(q.depth, stk.size());
+        child_reached = false; // reset return value
+    }
+    // after recursion, pop off the remaining accumulated features, as these are
+    // part of the biconnected component of HEAD
+    while (!acc.empty()) {
+        upstream[acc.top()] = true;
+        acc.pop();
+    }
+}
+
+void traverse(query &q) {
+    if (q.track_depth)
+        traverse_dfs<true>(q);
+    else
+        traverse_dfs<false>(q);
+}
+
+/* a barrier for a fixed number of threads, sleeping until all have arrived
+ */
+struct team_barrier {
+    std::mutex lock;
+    std::condition_variable wake;
+    uint32_t count = 0, phase = 0, total;
+    team_barrier(uint32_t total) : total(total) {}
+    void wait() {
+        std::unique_lock<std::mutex> hold(lock);
+        uint32_t p = phase;
+        if (++count == total) {
+            count = 0;
+            ++phase;
+            wake.notify_all();
+        } else {
+            wake.wait(hold, [&]() { return phase != p; });
+        }
+    }
+};
+
+/* returns the representative of @x in the concurrent union-find @uf, halving
+ * the path on the way
+ */
+static inline uint32_t uf_find(std::vector<std::atomic<uint32_t> > &uf,
+        uint32_t x) {
+    for (;;) {
+        uint32_t p = uf[x].load(std::memory_order_relaxed);
+        if (p == x)
+            return x;
+        uint32_t g = uf[p].load(std::memory_order_relaxed);
+        if (g != p)
+            uf[x].compare_exchange_weak(p, g, std::memory_order_relaxed);
+        x = g;
+    }
+}
+
+/* joins the sets of @a and @b in @uf, always hanging the larger representative
+ * below the smaller so that no cycle can form
+ */
+static inline void uf_unite(std::vector<std::atomic<uint32_t> > &uf,
+        uint32_t a, uint32_t b) {
+    for (;;) {
+        a = uf_find(uf, a);
+        b = uf_find(uf, b);
+        if (a == b)
+            return;
+        if (a < b)
+            std::swap(a, b);
+        uint32_t expect = a;
+        if (uf[a].compare_exchange_strong(expect, b))
+            return;
+    }
+}
+
+void par_traverse(query &q) {
+    const overlay &ov = q.ov;
+    const uint32_t n = ov.nodes, NONE = UINT32_MAX;
+    // levels narrower than this are not worth a barrier
+    const size_t GRAIN = 1024;
+    const uint32_t threads = std::max<uintf>(q.threads, 1);
+    // parent[v] is the parent of v in the spanning tree (TAIL for TAIL itself)
+    // and tree[v] the arc of the parent leading to v
+    std::vector<std::atomic<uint32_t> > parent(n), uf(n);
+    std::vector<const arc *> tree(n, nullptr);
+    std::vector<uint32_t> size(n), pre(n), low(n), high(n), label(n);
+    std::vector<char> mark(n, 0), up(n, 0);
+    // the vertices in BFS order, level l being order[level[l]..level[l+1])
+    std::vector<uint32_t> order(1, TAIL), level = { 0, 1 };
+    std::vector<std::vector<uint32_t> > found(threads);
+    team_barrier barrier(threads);
+
+    auto work = [&](uint32_t t) {
+        // the share of thread t of the items lo..hi-1
+        auto share = [&](size_t lo, size_t hi, size_t &from, size_t &to) {
+            from = lo + (hi - lo) * t / threads;
+            to = lo + (hi - lo) * (t+1) / threads;
+        };
+        // the tree children of v are the ends of the arcs they hang from
+        auto is_child = [&](uint32_t v, const arc *a) {
+            return tree[a->to] == a && a->to != v;
+        };
+        size_t from, to;
+        share(0, n, from, to);
+        for (size_t v = from; v < to; ++v) {
+            parent[v].store(NONE, std::memory_order_relaxed);
+            uf[v].store(v, std::memory_order_relaxed);
+        }
+        barrier.wait();
+        if (t == 0)
+            parent[TAIL] = TAIL;
+        barrier.wait();
+
+        // 1. the spanning tree
+        auto expand = [&](size_t from, size_t to, std::vector<uint32_t> &out) {
+            for (size_t i = from; i < to; ++i) {
+                uint32_t v = order[i];
+                const arc *begin, *end;
+                neighbours(ov, v, begin, end);
+                for (const arc *a = begin; a != end; ++a) {
+                    uint32_t w = a->to, expect = NONE;
+                    if (parent[w].load(std::memory_order_relaxed) == NONE
+                            && parent[w].compare_exchange_strong(expect, v)) {
+                        tree[w] = a;
+                        out.push_back(w);
+                    }
+                }
+            }
+        };
+        auto wide = [&](size_t l) { return level[l+1] - level[l] >= GRAIN; };
+        for (size_t l = 0; level[l] < level[l+1]; l = level.size() - 2) {
+            if (!wide(l)) {
+                // thread 0 goes on alone while the levels stay narrow, once
+                // the others are done reading them
+                barrier.wait();
+                for (; t == 0 && level[l] < level[l+1] && !wide(l); ++l) {
+                    expand(level[l], level[l+1], found[0]);
+                    order.insert(order.end(), found[0].begin(), found[0].end());
+                    found[0].clear();
+                    level.push_back(order.size());
+                }
+                barrier.wait();
+                continue;
+            }
+            share(level[l], level[l+1], from, to);
+            expand(from, to, found[t]);
+            barrier.wait();
+            if (t == 0) {
+                for (std::vector<uint32_t> &f : found) {
+                    order.insert(order.end(), f.begin(), f.end());
+                    f.clear();
+                }
+                level.push_back(order.size());
+            }
+            barrier.wait();
+        }
+        if (parent[HEAD].load() == NONE)
+            return; // HEAD cannot reach TAIL
+
+        // the levels runs[k]..runs[k+1]-1 make up one step of the sweeps
+        // below: either a single wide level shared by the threads, or a run of
+        // narrow levels left to thread 0
+        size_t levels = level.size() - 2;
+        std::vector<size_t> runs(1, 0);
+        for (size_t l = 0; l < levels; ++l) {
+            if (l+1 == levels || wide(l) || wide(l+1))
+                runs.push_back(l+1);
+        }
+        // the three sweeps: subtree sizes (bottom-up), preorder numbers
+        // (top-down), and low and high (bottom-up)
+        enum { SIZE, PREORDER, LOWHIGH };
+        auto visit = [&](int sweep, uint32_t v) {
+            const arc *begin, *end;
+            neighbours(ov, v, begin, end);
+            if (sweep == SIZE) {
+                uint32_t s = 1;
+                for (const arc *a = begin; a != end; ++a) {
+                    if (is_child(v, a))
+                        s += size[a->to];
+                }
+                size[v] = s;
+            } else if (sweep == PREORDER) {
+                uint32_t next = pre[v] + 1;
+                for (const arc *a = begin; a != end; ++a) {
+                    if (is_child(v, a)) {
+                        pre[a->to] = next;
+                        next += size[a->to];
+                    }
+                }
+            } else {
+                uint32_t lo = pre[v], hi = pre[v];
+                for (const arc *a = begin; a != end; ++a) {
+                    uint32_t w = a->to;
+                    lo = std::min(lo, pre[w]);
+                    hi = std::max(hi, pre[w]);
+                    if (is_child(v, a)) {
+                        lo = std::min(lo, low[w]);
+                        hi = std::max(hi, high[w]);
+                    }
+                }
+                low[v] = lo;
+                high[v] = hi;
+            }
+        };
+        auto sweep = [&](int sweep, bool down) {
+            for (size_t k = 0; k+1 < runs.size(); ++k) {
+                size_t r = down ? k : runs.size() - 2 - k;
+                size_t lo = level[runs[r]], hi = level[runs[r+1]];
+                if (runs[r+1] - runs[r] == 1 && wide(runs[r]))
+                    share(lo, hi, from, to);
+                else
+                    from = lo, to = t == 0 ? hi : lo;
+                if (down) {
+                    for (size_t i = from; i < to; ++i)
+                        visit(sweep, order[i]);
+                } else {
+                    for (size_t i = to; i-- > from; )
+                        visit(sweep, order[i]);
+                }
+                barrier.wait();
+            }
+        };
+
+        // 2. subtree sizes, then preorder numbers, so that the subtree of v is
+        // numbered pre[v]..pre[v]+size[v]-1
+        sweep(SIZE, false);
+        if (t == 0)
+            pre[TAIL] = 0;
+        barrier.wait();
+        sweep(PREORDER, true);
+
+        // 3. low and high
+        sweep(LOWHIGH, false);
+
+        // 4. the components of the tree edges
+        share(1, order.size(), from, to);
+        for (size_t i = from; i < to; ++i) {
+            uint32_t v = order[i], p = parent[v].load(std::memory_order_relaxed);
+            if (p != TAIL && (low[v] < pre[p] || high[v] >= pre[p] + size[p]))
+                uf_unite(uf, v, p);
+            const arc *begin, *end;
+            neighbours(ov, v, begin, end);
+            for (const arc *a = begin; a != end; ++a) {
+                uint32_t w = a->to;
+                // w numbered before v and not above it
+                if (pre[w] < pre[v] && pre[v] >= pre[w] + size[w])
+                    uf_unite(uf, v, w);
+            }
+        }
+        barrier.wait();
+        for (size_t i = from; i < to; ++i)
+            label[order[i]] = uf_find(uf, order[i]);
+        barrier.wait();
+
+        // the components of the tree path from HEAD and those holding TAIL
+        if (t == 0) {
+            for (uint32_t v = HEAD; v != TAIL; v = parent[v].load())
+                mark[label[v]] = 1;
+            const arc *begin, *end;
+            neighbours(ov, TAIL, begin, end);
+            for (const arc *a = begin; a != end; ++a) {
+                if (is_child(TAIL, a))
+                    mark[label[a->to]] = 1;
+                // traverse() marks TAIL itself only once its DFS goes on
+                // past it, that is unless TAIL is adjacent to one vertex only
+                if (a->to != begin->to)
+                    up[TAIL] = 1;
+            }
+        }
+        barrier.wait();
+        // a vertex is upstream if the edge above or one below it is marked
+        share(1, order.size(), from, to);
+        for (size_t i = from; i < to; ++i) {
+            uint32_t v = order[i];
+            char u = mark[label[v]];
+            const arc *begin, *end;
+            neighbours(ov, v, begin, end);
+            for (const arc *a = begin; a != end && !u; ++a)
+                u = is_child(v, a) && mark[label[a->to]];
+            up[v] = u;
+        }
+    };
+    std::vector<std::thread> team;
+    for (uint32_t t = 1; t < threads; ++t)
+        team.emplace_back(work, t);
+    work(0);
+    for (std::thread &th : team)
+        th.join();
+
+    // every component has one tree edge for its representative
+    q.depth = level.size() - 2;
+    q.blocks = 0;
+    if (parent[HEAD].load() != NONE) {
+        for (size_t i = 1; i < order.size(); ++i)
+            q.blocks += label[order[i]] == order[i];
+    }
+    q.upstream.assign(n, false);
+    q.dfs.assign(n, std::make_pair(0, 0));
+    for (uint32_t v = 0; v < n; ++v) {
+        if (up[v]) {
+            q.upstream[v] = true;
+            q.dfs[v].first = 1;
+        }
+    }
+    q.upstream[HEAD] = true;
+}
+
+#endif
@@ -0,0 +1,426 @@
+/* UPSTREAM FEATURE LIBRARY
+ * author: Zach Goldthorpe
+ *
+ * The file implements the library interface [see upstream.h] over the headers
+ * of the program, and is its only translation unit: the headers define what
+ * they declare, so they are included here alone.
+ *
+ * answer:    find the upstream features of a query and hand them to its writer
+ * attribute: find the upstream features of each starting point of a query
+ */
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stack>
+#include <algorithm>
+#include <utility>
+#include "upstream.h"
+#include "network.h"
+#include "read_graph.h"
+#include "bc_index.h"
+#include "bc_edit.h"
+#include "traverse.h"
+#include "output.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "reorder.h"
+#include "contract.h"
+using namespace std;
+
+/* finds the upstream features for the starting points named by @ids, using the
+ * scratch state of @q, and writes them through @q.out (which must have been
+ * begun); the phases and counters of the query go into @q.stats, and the time
+ * spent finding them (in traverse() or the index) into @q.elapsed
+ */
+static void answer(query &q, const vector<string> &ids);
+
+/* finds the upstream features of each starting point named by @ids on its
+ * own, through the index of the network of @q [see index_attribute], and calls
+ * the function-type @action with the index of each starting point, whether it
+ * reaches a controller, the features upstream of every starting point that
+ * does (the same list every time) and its other features: those of a starting
+ * point are the latter, preceded by the former if it reaches a controller,
+ * each once. The time spent finding them goes into @q.stats and @q.elapsed as
+ * in answer(), and the time spent in @action into the output.
+ */
+template<typename FUNC>
+static void attribute(query &q, const vector<string> &ids,
+    const FUNC &action);
+
+
+// ==== DEFINITIONS ==== //
+
+network *network_read(const char *filename, const network_options &options) {
+    network *net = new network;
+    if (!read_graph(*net, filename, options.threads, options.low_memory,
+            options.pipeline)) {
+        delete net;
+        return nullptr;
+    }
+    return net;
+}
+
+network *network_read(const vector<string> &filenames) {
+    network *net = new network;
+    if (!read_shards(*net, filenames)) {
+        delete net;
+        return nullptr;
+    }
+    return net;
+}
+
+network *network_parse(const char *data, size_t len,
+        const network_options &options) {
+    network *net = new network;
+    if (!parse_graph(*net, data, len, options.threads, options.pipeline)) {
+        delete net;
+        return nullptr;
+    }
+    return net;
+}
+
+network *network_load(const char *filename) {
+    network *net = new network;
+    stat_time clock = stat_clock();
+    if (!load_snapshot(*net, filename)) {
+        delete net;
+        return nullptr;
+    }
+    stat_phase(net->stats, PH_LAYOUT, clock);
+    net->stats.vertices = net->nodes - 2;
+    net->stats.edges = net->edges;
+    return net;
+}
+
+bool network_save(const network *net, const char *filename) {
+    // a low-memory network has no names to save [see id_table.h]
+    return !net->contracted.built && !net->idx.fingerprint
+        && save_snapshot(*net, filename);
+}
+
+bool network_reorder(network *net, const char *order) {
+    reorder_kind kind = reorder_named(order);
+    // the index and the contraction are laid out over the old numbering
+    if (kind == REORDER_NONE || (net && (net->contracted.built
+            || !net->index.parent.empty())))
+        return false;
+    if (net) {
+        stat_time clock = stat_clock();
+        reorder_network(*net, kind);
+        stat_phase(net->stats, PH_LAYOUT, clock);
+    }
+    return true;
+}
+
+bool network_index(network *net, const char *controllers, const char *edits) {
+    if (net->index.parent.empty()) {
+        stat_time clock = stat_clock();
+        build_index(*net);
+        stat_phase(net->stats, PH_LAYOUT, clock);
+    }
+    vector<string> ids;
+    if (controllers && !read_ids(controllers, ids))
+        return false;
+    if (!controllers)
+        index_controllers(*net, ids);
+    if (edits && !read_edits(*net, edits, ids))
+        return false;
+    net->ctrls.clear();
+    for (const string &id : ids)
+        index_terminals(*net, jkey(id), net->ctrls);
+    net->indexed = true;
+    return true;
+}
+
+void network_contract(network *net) {
+    stat_time clock = stat_clock();
+    contract_network(*net);
+    stat_phase(net->stats, PH_LAYOUT, clock);
+}
+
+const run_stats &network_stats(const network *net) {
+    return net->stats;
+}
+
+void network_free(network *net) {
+    delete net;
+}
+
+query *query_new(const network *net, unsigned threads, bool sorted,
+        bool depth) {
+    query *q = new query;
+    q->ov.net = net;
+    q->threads = threads;
+    q->out.sorted = sorted;
+    q->track_depth = depth;
+    return q;
+}
+
+bool query_answer(query *q, const vector<string> &ids, int fd, bool blank) {
+    const network &net = *q->ov.net;
+    feature_out &out = q->out;
+    out.names = nullptr;
+    // in low-memory mode the names are only found once the query is complete
+    out.deferred = net.idx.fingerprint && !out.sorted;
+    out_begin(out, net, fd);
+    answer(*q, ids);
+    stat_time clock = stat_clock();
+    bool ok = !net.idx.fingerprint || out_names(out);
+    ok = out_end(out, blank) && ok;
+    stat_phase(q->stats, PH_OUTPUT, clock);
+    return ok;
+}
+
+bool query_answer(query *q, const vector<string> &ids,
+        vector<string> &names) {
+    const network &net = *q->ov.net;
+    feature_out &out = q->out;
+    out.deferred = net.idx.fingerprint && !out.sorted;
+    out_begin(out, net, -1);
+    out.names = &names;
+    answer(*q, ids);
+    stat_time clock = stat_clock();
+    bool ok = !net.idx.fingerprint || out_names(out);
+    out_end(out);
+    out.names = nullptr;
+    stat_phase(q->stats, PH_OUTPUT, clock);
+    return ok;
+}
+
+bool query_attribute(query *q, const vector<string> &ids, int fd,
+        bool by_feature) {
+    const network &net = *q->ov.net;
+    feature_out &out = q->out;
+    if (!net.indexed)
+        return false;
+    out.names = nullptr;
+    out.deferred = false;
+    bool ok = true;
+    if (!by_feature) {
+        attribute(*q, ids, [&](size_t i, bool reaches,
+                const vector<uint32_t> &common, const vector<uint32_t> &own) {
+            out_begin(out, net, fd);
+            out_text(out, jstr(ids[i]));
+            if (reaches) {
+                for (uint32_t f : common)
+                    out_feature(out, f);
+            }
+            for (uint32_t f : own)
+                out_feature(out, f);
+            ok = out_end(out, true) && ok;
+        });
+        return ok;
+    }
+    // the features common to the starting points reaching a controller are
+    // upstream of all of those; the others are gathered as <feature, starting
+    // point> pairs, then everything is written by feature
+    vector<uint32_t> shared, reaching, order;
+    vector<pair<uint32_t, uint32_t> > pairs;
+    attribute(*q, ids, [&](size_t i, bool reaches,
+            const vector<uint32_t> &common, const vector<uint32_t> &own) {
+        if (reaches && reaching.empty())
+            shared = common;
+        if (reaches)
+            reaching.push_back(i);
+        for (uint32_t f : own)
+            pairs.emplace_back(f, i);
+    });
+    stat_time clock = stat_clock();
+    stable_sort(pairs.begin(), pairs.end(),
+        [](const pair<uint32_t, uint32_t> &a,
+            const pair<uint32_t, uint32_t> &b) {
+        return a.first < b.first;
+    });
+    order = shared;
+    for (const pair<uint32_t, uint32_t> &p : pairs)
+        order.push_back(p.first);
+    sort(order.begin(), order.end());
+    order.erase(unique(order.begin(), order.end()), order.end());
+    if (out.sorted) {
+        sort(order.begin(), order.end(), [&net](uint32_t a, uint32_t b) {
+            char bx[GUID_TEXT], by[GUID_TEXT];
+            jstr x = feature_name(net, a, bx), y = feature_name(net, b, by);
+            int c = memcmp(x.s, y.s, min(x.n, y.n));
+            return c ? c < 0 : x.n < y.n;
+        });
+    }
+    sort(shared.begin(), shared.end());
+    out_begin(out, net, fd);
+    string line;
+    char buf[GUID_TEXT];
+    for (uint32_t f : order) {
+        jstr name = feature_name(net, f, buf);
+        line.assign(name.s, name.n);
+        if (binary_search(shared.begin(), shared.end(), f)) {
+            for (uint32_t i : reaching)
+                line.append("\t").append(ids[i]);
+        } else {
+            auto k = lower_bound(pairs.begin(), pairs.end(),
+                make_pair(f, 0u));
+            for (; k != pairs.end() && k->first == f; ++k)
+                line.append("\t").append(ids[k->second]);
+        }
+        out_text(out, jstr(line));
+    }
+    ok = out_end(out);
+    stat_phase(q->stats, PH_OUTPUT, clock);
+    return ok;
+}
+
+bool query_attribute(query *q, const vector<string> &ids,
+        vector<vector<string> > &names) {
+    const network &net = *q->ov.net;
+    feature_out &out = q->out;
+    if (!net.indexed)
+        return false;
+    out.deferred = false;
+    names.assign(ids.size(), vector<string>());
+    attribute(*q, ids, [&](size_t i, bool reaches,
+            const vector<uint32_t> &common, const vector<uint32_t> &own) {
+        out_begin(out, net, -1);
+        out.names = &names[i];
+        if (reaches) {
+            for (uint32_t f : common)
+                out_feature(out, f);
+        }
+        for (uint32_t f : own)
+            out_feature(out, f);
+        out_end(out);
+    });
+    out.names = nullptr;
+    return true;
+}
+
+double query_time(const query *q) {
+    return q->elapsed;
+}
+
+const run_stats &query_stats(const query *q) {
+    return q->stats;
+}
+
+void query_free(query *q) {
+    delete q;
+}
+
+static void answer(query &q, const vector<string> &ids) {
+    const network &net = *q.ov.net;
+    feature_out &out = q.out;
+    run_stats &rs = q.stats;
+    double before = rs.phase[PH_DFS];
+    stat_time clock = stat_clock();
+    if (net.indexed) {
+        // mark the subtree of the block-cut tree spanning the query
+        q.starts.clear();
+        for (const string &id : ids)
+            index_terminals(net, jkey(id), q.starts);
+        stat_phase(rs, PH_STARTINGPOINTS, clock);
+        index_upstream(net, q.starts, net.ctrls, q.up);
+        stat_phase(rs, PH_DFS, clock);
+        rs.split = net.splitedge.size();
+        for (uint32_t x : q.up)
+            out_feature(out, index_feature(net, x));
+        stat_phase(rs, PH_OUTPUT, clock);
+        q.elapsed = rs.phase[PH_DFS] - before;
+        return;
+    }
+
+    if (net.contracted.built)
+        contract_startingpoints(q.ov, ids);
+    else
+        set_startingpoints(q.ov, ids);
+    // recurse and find the upstream vertices
+    vector<bool> &upstream = q.upstream;
+    vector<uintp> &dfs = q.dfs;
+    upstream.assign(q.ov.nodes, false);
+    dfs.assign(q.ov.nodes, make_pair(0, 0));
+    stat_phase(rs, PH_STARTINGPOINTS, clock);
+    if (q.threads)
+        par_traverse(q);
+    else
+        traverse(q);
+    stat_phase(rs, PH_DFS, clock);
+    rs.split = net.splitedge.size() + q.ov.split.size();
+    rs.depth = q.depth;
+    rs.blocks = q.blocks;
+
+    // use this information to find and print the upstream features (an edge
+    // collapsed from a chain standing for all of its features)
+    auto emit = [&out](uint32_t f) { out_feature(out, f); };
+    stack<uintf> find_upstream;
+    find_upstream.push(0);
+    dfs[0].first = 0;
+    // dfs[v].first being 0 will indicate that it has already been recursed on
+    while (!find_upstream.empty()) {
+        uintf v = find_upstream.top();
+        find_upstream.pop();
+        out_feature(out, vertex_feature(q.ov, v));
+        const arc *begin, *end;
+        neighbours(q.ov, v, begin, end);
+        for (const arc *a = begin; a != end; ++a) {
+            uintf u = a->to;
+            if (!upstream[u])
+                continue;
+            if (u > v)
+                chain_features(q.ov, a->edge, emit);
+            if (dfs[u].first) {
+                dfs[u].first = 0;
+                find_upstream.push(u);
+                out_feature(out, vertex_feature(q.ov, u));
+            }
+        }
+    }
+    hung_features(q.ov, upstream, emit);
+    stat_phase(rs, PH_OUTPUT, clock);
+    q.elapsed = rs.phase[PH_DFS] - before;
+}
+
+template<typename FUNC>
+static void attribute(query &q, const vector<string> &ids,
+        const FUNC &action) {
+    const network &net = *q.ov.net;
+    run_stats &rs = q.stats;
+    double before = rs.phase[PH_DFS];
+    stat_time clock = stat_clock();
+    vector<vector<uint32_t> > starts(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i)
+        index_terminals(net, jkey(ids[i]), starts[i]);
+    stat_phase(rs, PH_STARTINGPOINTS, clock);
+
+    // the features of the vertices upstream of every starting point reaching
+    // a controller are listed once in common (and marked in shared); seen[f]
+    // is i+1 once feature f is listed in own for starting point i
+    vector<uint32_t> vertices, common, own;
+    vector<bool> shared(features(net), false);
+    vector<uint32_t> seen(features(net), 0);
+    bool first = true;
+    index_attribute(net, starts, net.ctrls, vertices,
+            [&](size_t i, bool reaches, const vector<uint32_t> &path) {
+        if (first) {
+            for (uint32_t x : vertices) {
+                uint32_t f = index_feature(net, x);
+                if (f != NOFEATURE && !shared[f]) {
+                    shared[f] = true;
+                    common.push_back(f);
+                }
+            }
+            first = false;
+        }
+        own.clear();
+        for (uint32_t x : path) {
+            uint32_t f = index_feature(net, x);
+            if (f != NOFEATURE && !shared[f] && seen[f] != i+1) {
+                seen[f] = i+1;
+                own.push_back(f);
+            }
+        }
+        stat_phase(rs, PH_DFS, clock);
+        action(i, reaches, common, own);
+        stat_phase(rs, PH_OUTPUT, clock);
+    });
+    stat_phase(rs, PH_DFS, clock);
+    rs.split = net.splitedge.size();
+    q.elapsed = rs.phase[PH_DFS] - before;
+}
@@ -0,0 +1,195 @@
+/* UPSTREAM FEATURE LIBRARY
+ * author: Zach Goldthorpe
+ *
+ * The file is the interface of the library behind the giscup-2018 program
+ * [see upstream_features.cpp], built on its own as libupstream.a. It keeps no
+ * state of its own: everything is held by the two objects below.
+ *
+ * A network is built once, from a JSON file, from JSON in memory or from a
+ * snapshot, and is only read from then on. Its index, reordering and
+ * contraction, if wanted, are applied right after it is built, before any
+ * query runs on it.
+ *
+ * A query holds the scratch arrays of the queries against one network, and is
+ * reused from one to the next. Any number of queries may run against the same
+ * network at once, one per thread, without any locking: the only shared state
+ * is the network, and it is not written to.
+ *
+ * network_read:     build a network from a JSON file (or several)
+ * network_parse:    build a network from JSON in memory
+ * network_load:     map a network from a snapshot
+ * network_save:     write a network to a snapshot
+ * network_reorder:  renumber the junctions of a network
+ * network_index:    build the block-cut tree index of a network
+ * network_contract: prune the trees and chains out of a network
+ * network_stats:    the statistics of building a network
+ * network_free:     release a network
+ * query_new:        make the state of the queries against a network
+ * query_answer:     find the upstream features of some starting points
+ * query_attribute:  find the upstream features of each starting point
+ * query_time:       the time the last query spent finding the components
+ * query_stats:      the statistics of the queries answered so far
+ * query_free:       release a query
+ * read_ids:         read ID's from a text file
+ */
+
+#ifndef _upstream_h_
+#define _upstream_h_
+#include <string>
+#include <vector>
+#include "stats.h"
+
+struct network;
+struct query;
+
+/* how network_read builds a network
+ */
+struct network_options {
+    unsigned threads = 1; // the threads parsing the rows
+    // keep fingerprints of the ID's instead of the ID's, finding the names of
+    // the features a query writes in a second pass over the JSON
+    bool low_memory = false;
+    // read the rows on one thread while another adds them to the network (in
+    // place of the threads above)
+    bool pipeline = false;
+};
+
+/* builds the network of the JSON file @filename [see read_graph.h]
+ *
+ * returns nullptr if the file could not be read or is malformed
+ */
+network *network_read(const char *filename,
+    const network_options &options = network_options());
+
+/* builds the network held between the JSON files @filenames, parsing each on
+ * a thread of its own and then merging them, as if their rows and their
+ * controllers were listed in a single file in order [see read_shards]
+ *
+ * returns nullptr if one of the files could not be read or is malformed
+ */
+network *network_read(const std::vector<std::string> &filenames);
+
+/* builds the network of the @len bytes of JSON at @data, which need not
+ * outlive it (without the low-memory mode)
+ *
+ * returns nullptr if the JSON is malformed (holds no object, or ends inside
+ * one)
+ */
+network *network_parse(const char *data, size_t len,
+    const network_options &options = network_options());
+
+/* maps the network saved in the snapshot @filename [see snapshot.h]
+ *
+ * returns nullptr if the file could not be mapped or is not a valid snapshot
+ */
+network *network_load(const char *filename);
+
+/* writes @net to the snapshot @filename
+ *
+ * returns false if @net is contracted or was read in low-memory mode, or the
+ * file could not be written
+ */
+bool network_save(const network *net, const char *filename);
+
+/* renumbers the junctions of @net, read from JSON and not yet indexed, in the
+ * order named @order ("bfs", "rcm" or "dfs") [see reorder.h]; a null @net
+ * only checks the name
+ *
+ * returns false (leaving @net as it is) if there is no such order or @net is
+ * indexed or contracted
+ */
+bool network_reorder(network *net, const char *order);
+
+/* makes the queries against @net go through its block-cut tree index [see
+ * bc_index.h], building it unless it was loaded with @net; the controllers
+ * are those listed in the text file @controllers if given, and those of the
+ * network otherwise, and the edits listed in the text file @edits are applied
+ * if given [see bc_edit.h]
+ *
+ * returns false if the controllers could not be read or the edits could not
+ * be applied
+ */
+bool network_index(network *net, const char *controllers = nullptr,
+    const char *edits = nullptr);
+
+/* prunes the trees hanging off the graph of @net and collapses its chains of
+ * vertices of degree 2 [see contract.h], so that the queries not going
+ * through the index walk a smaller graph; @net can no longer be saved or
+ * reordered afterwards
+ */
+void network_contract(network *net);
+
+/* returns the statistics of building @net [see stats.h]
+ */
+const run_stats &network_stats(const network *net);
+
+/* releases @net, which no query may use any more
+ */
+void network_free(network *net);
+
+/* makes the state of the queries against @net, finding the components on
+ * @threads threads (0 for the serial DFS) and writing the features of each
+ * query sorted by name if @sorted is set; the serial DFS only counts the depth
+ * of its stack for the statistics if @depth is set
+ */
+query *query_new(const network *net, unsigned threads = 0,
+    bool sorted = false, bool depth = false);
+
+/* finds the upstream features of @net for the starting points named by @ids,
+ * and writes their names, one per line, to the descriptor @fd, followed by an
+ * empty line if @blank is set
+ *
+ * returns false if the names could not all be written (or, in low-memory
+ * mode, the JSON could not be read again)
+ */
+bool query_answer(query *q, const std::vector<std::string> &ids, int fd,
+    bool blank = false);
+
+/* as above, appending the names to @names instead
+ */
+bool query_answer(query *q, const std::vector<std::string> &ids,
+    std::vector<std::string> &names);
+
+/* finds the upstream features of each starting point named by @ids on its
+ * own, through the index of @net (which must have been indexed [see
+ * network_index]), for about the cost of a single query. Unless @by_feature
+ * is set, writes a paragraph per starting point to the descriptor @fd: its ID
+ * as given, then its upstream features, one per line, then an empty line.
+ * Otherwise writes a line per feature upstream of any starting point: its
+ * name followed by the ID's of those starting points, separated by tabs.
+ * The paragraphs follow @ids, and the lines the order of the features in the
+ * network [see read_graph.h]; the features of each paragraph, or the lines,
+ * are sorted by name instead if @q writes sorted features.
+ *
+ * returns false if @net is not indexed or the features could not all be
+ * written
+ */
+bool query_attribute(query *q, const std::vector<std::string> &ids, int fd,
+    bool by_feature = false);
+
+/* as above, setting @names[i] to the upstream features of the starting point
+ * @ids[i] instead
+ */
+bool query_attribute(query *q, const std::vector<std::string> &ids,
+    std::vector<std::vector<std::string> > &names);
+
+/* returns the time the last query of @q spent finding the components, in
+ * seconds
+ */
+double query_time(const query *q);
+
+/* returns the statistics of the queries answered by @q so far
+ */
+const run_stats &query_stats(const query *q);
+
+/* releases @q
+ */
+void query_free(query *q);
+
+/* appends the lines of the text file @filename to @ids
+ *
+ * returns false if the file could not be read
+ */
+bool read_ids(const char *filename, std::vector<std::string> &ids);
+
+#endif
@@ -48,158 +48,461 @@
  */
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <vector>
-#include <stack>
-#include <cstdint>
-#include "read_graph.h"
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "upstream.h"
 using namespace std;
 
-using uintf = uint_fast32_t;
-using uintp = pair<uintf, uintf>;
+// the program is a thin wrapper over the library [see upstream.h]: it builds
+// the one network it answers for, then runs its queries against it
+static network *net = nullptr;
+// the threads par_traverse() runs on for each query, or 0 to use traverse()
+static unsigned parallel = 0;
+// whether the features of each query are written sorted by name
+static bool sorted = false;
 
-// graph[v] stores a vector of <neighbour, edge_idx> pairs for the vertex v
-vector<vector<uintp> > graph;
-// name, edgename map indices to the original names provided by the JSON
-vector<string> name, edgename;
-// upstream[v] indicates that vertex v is an upstream feature
-// badedge[e] indicates whether edge e has been deleted or not (reduction 1)
-vector<bool> upstream, badedge;
-// dfs[v] stores <dfs_count, dfs_low> pairs for the DFS that finds articulation
-// points (step 1)
-vector<uintp> dfs;
-// tracks how many nodes are in the graph;
-uintf nodes = 0;
+/* answers every query listed in the text file @jobs, one per line as the path
+ * of a starting points file and the path of its output file separated by
+ * whitespace, on @threads threads sharing the network; a query whose starting
+ * points file cannot be read is skipped, leaving its output file alone
+ *
+ * returns false if the jobs file could not be read, or some query could not be
+ * answered
+ */
+bool batch(const char *jobs, unsigned threads, bool verbose);
 
-/* traverse through the constructed graph in a non-recursive DFS to find the
- * biconnected components which lie along the path from HEAD to TAIL, recording
- * the info into "upstream"
+/* answers the queries read from @in, writing the answers to the descriptor
+ * @out: a query is a list of starting point ID's, one per line, ended by an
+ * empty line (or the end of the input), and its answer is the list of upstream
+ * features, one per line, likewise ended by an empty line
+ */
+void serve(FILE *in, int out, bool verbose);
+
+/* listens on the Unix domain socket at @path, serving each connection as above
+ * in turn
+ *
+ * returns false if the socket could not be set up
  */
-void traverse();
+bool serve_socket(const char *path, bool verbose);
+
+/* builds the network held between the JSON files listed in the text file
+ * @manifest, one per line (relative to the directory of the manifest, unless
+ * absolute), each parsed on a thread of its own
+ *
+ * returns nullptr if the manifest, or some file it lists, could not be read
+ */
+network *read_manifest(const char *manifest);
 
 int main(int argc, char **argv) {
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s <data.json> <startingpoints.txt> <output.txt>\n", argv[0]);
+    // -j sets the number of threads parsing the rows and answering a batch
+    // (0 for one per core)
+    // -v reports the time spent reading the network, in traverse() and writing
+    // the features, and the peak memory use
+    // --save-snapshot writes the network read from the JSON to a snapshot
+    // --load-snapshot reads the network from a snapshot instead of the JSON
+    // --serve answers queries on the standard input instead of the files
+    // --socket answers queries on a Unix domain socket instead of the files
+    // --index answers through the block-cut tree index (building it unless the
+    // snapshot has it)
+    // --controllers replaces the controllers of the network (with --index)
+    // --batch answers the queries listed in a file instead of the files
+    // --edits applies the edits listed in a file to the network (with --index)
+    // --parallel finds the components on the -j threads (except in a batch,
+    // whose queries already run side by side)
+    // --sorted writes the features of each query sorted by name
+    // --stats reports the time of each phase and the counters of the run (as
+    // json with --stats=json), after the query or once the network is ready
+    // --low-memory keeps fingerprints of the ID's instead of the ID's, finding
+    // the names of the features written in a second pass over the JSON (for a
+    // single query read from the JSON only)
+    // --reorder renumbers the junctions of the network read from the JSON in
+    // bfs, rcm or dfs order, so that traverse() finds neighbours close together
+    // --pipeline reads the rows of the JSON on one thread while another adds
+    // them to the network, in place of the -j threads
+    // --attribute writes the upstream features of each starting point on its
+    // own, as a paragraph per starting point (or, with --attribute=features,
+    // as a line per feature listing its starting points), through the index
+    // --contract prunes the trees hanging off the network and collapses its
+    // chains of vertices of degree 2 before the queries (after saving any
+    // snapshot), so that traverse() walks a smaller graph
+    // --shards reads the network from the JSON files listed in a manifest,
+    // one per line (relative to the manifest), each on a thread of its own,
+    // in place of a single JSON
+    static const struct option longopts[] = {
+        { "save-snapshot", required_argument, nullptr, 'S' },
+        { "load-snapshot", required_argument, nullptr, 'L' },
+        { "serve", no_argument, nullptr, 'D' },
+        { "socket", required_argument, nullptr, 'U' },
+        { "index", no_argument, nullptr, 'I' },
+        { "controllers", required_argument, nullptr, 'C' },
+        { "batch", required_argument, nullptr, 'B' },
+        { "edits", required_argument, nullptr, 'E' },
+        { "parallel", no_argument, nullptr, 'P' },
+        { "sorted", no_argument, nullptr, 'O' },
+        { "stats", optional_argument, nullptr, 'T' },
+        { "low-memory", no_argument, nullptr, 'M' },
+        { "reorder", required_argument, nullptr, 'R' },
+        { "pipeline", no_argument, nullptr, 'Q' },
+        { "attribute", optional_argument, nullptr, 'A' },
+        { "contract", no_argument, nullptr, 'K' },
+        { "shards", required_argument, nullptr, 'H' },
+        { nullptr, 0, nullptr, 0 }
+    };
+    unsigned threads = 1;
+    bool verbose = false, serving = false, indexed = false;
+    const char *save = nullptr, *load = nullptr, *sock = nullptr;
+    const char *controllers = nullptr, *jobs = nullptr, *edits = nullptr;
+    bool par = false, low = false, pipeline = false, contract = false;
+    int report = 0; // 1 for a --stats report as text, 2 as json
+    int attribute = 0; // 1 to --attribute by starting point, 2 by feature
+    const char *reorder = nullptr, *manifest = nullptr;
+    for (int opt; (opt = getopt_long(argc, argv, "j:v", longopts, nullptr))
+            != -1; ) {
+        if (opt == 'j') {
+            threads = strtoul(optarg, nullptr, 10);
+            if (!threads)
+                threads = max(thread::hardware_concurrency(), 1u);
+        } else if (opt == 'v') {
+            verbose = true;
+        } else if (opt == 'S') {
+            save = optarg;
+        } else if (opt == 'L') {
+            load = optarg;
+        } else if (opt == 'D') {
+            serving = true;
+        } else if (opt == 'U') {
+            sock = optarg;
+        } else if (opt == 'I') {
+            indexed = true;
+        } else if (opt == 'C') {
+            controllers = optarg;
+        } else if (opt == 'B') {
+            jobs = optarg;
+        } else if (opt == 'E') {
+            edits = optarg;
+        } else if (opt == 'P') {
+            par = true;
+        } else if (opt == 'O') {
+            sorted = true;
+        } else if (opt == 'T' && (!optarg || !strcmp(optarg, "text"))) {
+            report = 1;
+        } else if (opt == 'T' && !strcmp(optarg, "json")) {
+            report = 2;
+        } else if (opt == 'M') {
+            low = true;
+        } else if (opt == 'R' && network_reorder(nullptr, optarg)) {
+            reorder = optarg;
+        } else if (opt == 'Q') {
+            pipeline = true;
+        } else if (opt == 'A' && (!optarg || !strcmp(optarg, "starts"))) {
+            attribute = 1;
+        } else if (opt == 'A' && !strcmp(optarg, "features")) {
+            attribute = 2;
+        } else if (opt == 'K') {
+            contract = true;
+        } else if (opt == 'H') {
+            manifest = optarg;
+        } else {
+            argc = 0; // unknown option, so print usage
+            break;
+        }
+    }
+    // the JSON is left out when loading a snapshot, and the starting points
+    // and output when serving queries, answering a batch or only saving a
+    // snapshot
+    serving |= sock != nullptr || jobs != nullptr;
+    indexed |= attribute != 0;
+    int json = load || manifest ? 0 : 1, files = argc - optind;
+    if ((load && save) || ((controllers || edits) && !indexed)
+            || (manifest && (load || low || pipeline))
+            || (edits && save) || (low && (load || save || serving || indexed))
+            || (load && (reorder || pipeline))
+            || (attribute && (serving || save)) || (contract && indexed)
+            || (files != json + (serving ? 0 : 2)
+            && !(save && !serving && files == json))) {
+        fprintf(stderr, "Usage: %s [-j threads] [-v] [--save-snapshot <network.snap>] <data.json> <startingpoints.txt> <output.txt>\n"
+            "       %s [-j threads] --save-snapshot <network.snap> <data.json>\n"
+            "       %s [-v] --load-snapshot <network.snap> <startingpoints.txt> <output.txt>\n"
+            "       %s [-j threads] [-v] [--save-snapshot <network.snap>] --serve|--socket <path> <data.json>\n"
+            "       %s [-v] --load-snapshot <network.snap> --serve|--socket <path>\n"
+            "       %s [-j threads] [-v] --batch <jobs.txt> <data.json>|--load-snapshot <network.snap>\n"
+            "       any of the above with --index [--controllers <controllers.txt>] [--edits <edits.txt>]\n"
+            "       any of the above with --parallel, --sorted and --stats[=json]\n"
+            "       any of the above without --index with --contract\n"
+            "       any of the above reading the JSON with --reorder bfs|rcm|dfs and --pipeline\n"
+            "       any of the above reading the JSON with --shards <manifest.txt> in place of <data.json> (but --pipeline)\n"
+            "       %s [-j threads] [--pipeline] [-v] --low-memory <data.json> <startingpoints.txt> <output.txt>\n"
+            "       %s [-v] --attribute[=starts|features] [--controllers <controllers.txt>] [--edits <edits.txt>] <data.json>|--load-snapshot <network.snap> <startingpoints.txt> <output.txt>\n",
+            argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+            argv[0]);
         return -1;
     }
-    // build the graph
-    read_graph(argv[1], argv[2]);
-
-    // recurse and find the upstream vertices
-    upstream = vector<bool>(nodes, false);
-    dfs = vector<uintp>(nodes, make_pair(0, 0));
-    traverse();
-
-    // use this information to find and print the upstream features
-    ofstream fout(argv[3]);
-    stack<uintf> find_upstream;
-    find_upstream.push(0);
-    dfs[0].first = 0;
-    // dfs[v].first being 0 will indicate that it has already been recursed on
-    while (!find_upstream.empty()) {
-        uintf v = find_upstream.top();
-        find_upstream.pop();
-        fout << name[v];
-        for (const uintp &p : graph[v]) {
-            uintf u = p.first;
-            if (!upstream[u])
-                continue;
-            if (u > v)
-                fout << edgename[p.second];
-            if (dfs[u].first) {
-                dfs[u].first = 0;
-                find_upstream.push(u);
-                fout << name[u];
-            }
+    char **pos = argv + optind; // the files, in order
+    if (par)
+        parallel = threads;
+    // build the network
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if (load && !(net = network_load(load))) {
+        fprintf(stderr, "%s: cannot load snapshot %s\n", argv[0], load);
+        return -1;
+    }
+    network_options options;
+    options.threads = threads;
+    options.low_memory = low;
+    options.pipeline = pipeline;
+    if (manifest && !(net = read_manifest(manifest))) {
+        if (access(manifest, R_OK) != 0)
+            fprintf(stderr, "%s: cannot read %s\n", argv[0], manifest);
+        else
+            fprintf(stderr, "%s: cannot read the shards of %s\n", argv[0],
+                manifest);
+        return -1;
+    }
+    if (!load && !manifest && !(net = network_read(pos[0], options))) {
+        fprintf(stderr, "%s: cannot read %s\n", argv[0], pos[0]);
+        return -1;
+    }
+    if (reorder)
+        network_reorder(net, reorder);
+    if (network_stats(net).collisions) {
+        fprintf(stderr, "%s: %llu ID's share a 64-bit hash with another, and "
+            "are told apart by their check hashes\n", argv[0],
+            (unsigned long long)network_stats(net).collisions);
+    }
+    if (indexed && !network_index(net, controllers, edits)) {
+        // the controllers are read before the edits are applied (and
+        // read_edits reports the edit it stopped at)
+        if (controllers && access(controllers, R_OK) != 0)
+            fprintf(stderr, "%s: cannot read %s\n", argv[0], controllers);
+        else
+            fprintf(stderr, "%s: cannot apply %s\n", argv[0],
+                edits ? edits : "the index");
+        return -1;
+    }
+    if (save && !network_save(net, save)) {
+        fprintf(stderr, "%s: cannot write snapshot %s\n", argv[0], save);
+        return -1;
+    }
+    if (contract)
+        network_contract(net);
+    if (report && (serving || files == json)) // no query of its own
+        stats_report(network_stats(net), stderr, report == 2);
+    if (sock) {
+        if (!serve_socket(sock, verbose)) {
+            fprintf(stderr, "%s: cannot listen on %s\n", argv[0], sock);
+            return -1;
         }
+        return 0;
+    }
+    if (jobs)
+        return batch(jobs, threads, verbose) ? 0 : -1;
+    if (serving) {
+        serve(stdin, STDOUT_FILENO, verbose);
+        return 0;
+    }
+    if (files == json)
+        return 0; // only saving the snapshot
+    vector<string> ids;
+    if (!read_ids(pos[json], ids)) {
+        fprintf(stderr, "%s: cannot read %s\n", argv[0], pos[json]);
+        return -1;
     }
-    fout.close();
+    chrono::duration<double> reading = chrono::steady_clock::now() - start;
 
+    // find and print the upstream features
+    query *q = query_new(net, parallel, sorted, report != 0);
+    int fd = open(pos[json+1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "%s: cannot write %s\n", argv[0], pos[json+1]);
+        return -1;
+    }
+    start = chrono::steady_clock::now();
+    bool ok = attribute ? query_attribute(q, ids, fd, attribute == 2)
+        : query_answer(q, ids, fd);
+    if (close(fd) < 0 || !ok) {
+        fprintf(stderr, "%s: cannot write %s\n", argv[0], pos[json+1]);
+        return -1;
+    }
+    // the features are written during the sweep after traverse(), so writing
+    // counts everything but traverse() itself
+    chrono::duration<double> writing = chrono::steady_clock::now() - start;
+    double elapsed = query_time(q);
+
+    if (verbose) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        fprintf(stderr, "read: %.3f s\ntraverse: %.3f s\nwrite: %.3f s\n"
+            "peak memory: %.1f MB\n", reading.count(), elapsed,
+            writing.count() - elapsed, usage.ru_maxrss / 1024.0);
+    }
+    if (report) {
+        run_stats total = network_stats(net);
+        stats_add(total, query_stats(q));
+        stats_report(total, stderr, report == 2);
+    }
+    query_free(q);
+    network_free(net);
     return 0;
 }
 
 // ==== DEFINITIONS ==== //
 
-void traverse() {
-    // struct representing the recursion stack frame for the original DFS
-    struct frame {
-        // @v denotes the vertex of the DFS, @parent its parent
-        // @i denotes the index of the edge it has last checked (originally -1)
-        // @best stores the best value of dfs_count encountered [see @dfs]
-        // @reached stores if @v can reach TAIL in the DFS
-        // @started stores if any edge has been explored yet
-        uintf v, i, best;
-        bool reached, started;
-        frame(uintf v, uintf i, uintf best, bool reached, bool started)
-            : v(v), i(i), best(best), reached(reached), started(started) {}
-    };
-    // count tracks dfs_count for the entire recursion
-    uintf count = 1;
-    // acc accumulates vertices during the DFS until a biconnected component is
-    // fully realised
-    stack<uintf> acc;
-    // stk serves as the substitute for the recursion stack
-    stack<frame> stk;
-    stk.emplace(0, 0, count++, false, false);
-    // child_reached will store the return value of the recursive call
-    bool child_reached = false;
-
-    while (!stk.empty()) {
-        frame fm = stk.top();
-        stk.pop();
-        fm.reached |= child_reached; // fetch return value
-        if (fm.started) {
-            // we have already seen at least one edge, so check for a
-            // biconnected component
-            uintf u = graph[fm.v][fm.i].first;
-            if (dfs[u].second >= dfs[fm.v].first) {
-                // we have found an articulation point
-                while (acc.top() != u) {
-                    // this biconnected component is upstream
-                    upstream[acc.top()] = upstream[acc.top()]|child_reached;
-                    acc.pop();
-                }
-                upstream[u] = upstream[u]|child_reached;
-                acc.pop();
-            } else fm.best = min(fm.best, dfs[u].second);
-
-            ++fm.i; // examine next edge
-        } else {
-            // otherwise, we have seen this vertex for the first time
-            dfs[fm.v] = make_pair(fm.best, fm.best);
-            acc.push(fm.v);
+void serve(FILE *in, int out, bool verbose) {
+    query *q = query_new(net, parallel, sorted);
+    vector<string> ids;
+    char *line = nullptr;
+    size_t cap = 0;
+    for (bool more = true; more; ) {
+        ssize_t len = getline(&line, &cap, in);
+        more = len >= 0;
+        if (more && line[len-1] == '\n')
+            line[--len] = '\0';
+        if (more && len > 0) {
+            ids.emplace_back(line, len);
+            continue;
         }
-        while (fm.i < graph[fm.v].size()
-                && (dfs[graph[fm.v][fm.i].first].first > 0
-                    || badedge[graph[fm.v][fm.i].second])) {
-            // skip the edges that have already  been recursed or have been
-            // deleted from reduction 1
-            if (!badedge[graph[fm.v][fm.i].second]) {
-                // check if we can reach TAIL but otherwise fetch already
-                // obtained information
-                fm.reached |= graph[fm.v][fm.i].first == TAIL;
-                fm.best = min(fm.best, dfs[graph[fm.v][fm.i].first].second);
-            }
-            ++fm.i;
+        if (!more && ids.empty())
+            break; // no query left at the end of the input
+        // an empty line (or the end of the input) completes the query
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        bool ok = query_answer(q, ids, out, true);
+        if (verbose) {
+            chrono::duration<double> total
+                = chrono::steady_clock::now() - start;
+            fprintf(stderr, "query: %zu starting points, traverse: %.3f s, "
+                "total: %.3f s\n", ids.size(), query_time(q), total.count());
+        }
+        ids.clear();
+        if (!ok)
+            break; // the other end has gone away
+    }
+    free(line);
+    query_free(q);
+}
+
+bool serve_socket(const char *path, bool verbose) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return false;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+    unlink(path); // a socket left behind by an earlier server
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+            || listen(fd, 16) < 0) {
+        close(fd);
+        return false;
+    }
+    // a client leaving early must not take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+    for (;;) {
+        int conn = accept(fd, nullptr, nullptr);
+        if (conn < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
         }
-        if (fm.i == graph[fm.v].size()) {
-            // we have exhausted the edges of this vertex
-            dfs[fm.v].second = fm.best;
-            child_reached = fm.reached;
+        FILE *in = fdopen(conn, "r");
+        if (!in) {
+            close(conn);
             continue;
         }
-        // recurse through edge fm.i
-        fm.reached |= graph[fm.v][fm.i].first == TAIL;
-        fm.started = 1;
-        stk.push(fm);
-        stk.emplace(graph[fm.v][fm.i].first, 0, count++, false, false);
-        child_reached = false; // reset return value
-    }
-    // after recursion, pop off the remaining accumulated features, as these are
-    // part of the biconnected component of HEAD
-    while (!acc.empty()) {
-        upstream[acc.top()] = true;
-        acc.pop();
-    }
-}
\ No newline at end of file
+        serve(in, conn, verbose);
+        fclose(in); // also closes conn
+    }
+    close(fd);
+    unlink(path);
+    return true;
+}
+
+bool batch(const char *jobs, unsigned threads, bool verbose) {
+    vector<pair<string, string> > work;
+    ifstream fin(jobs);
+    if (!fin) {
+        fprintf(stderr, "cannot read %s\n", jobs);
+        return false;
+    }
+    for (string line; getline(fin, line); ) {
+        istringstream fields(line);
+        string sp, out;
+        if (fields >> sp >> out)
+            work.emplace_back(sp, out);
+    }
+    fin.close();
+
+    // the workers take the queries in turn, each with its own scratch state
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    atomic<size_t> next(0);
+    atomic<bool> ok(true);
+    vector<thread> workers;
+    for (unsigned t = 0; t < min<size_t>(threads, work.size()); ++t) {
+        workers.emplace_back([&]() {
+            query *q = query_new(net, 0, sorted);
+            vector<string> ids;
+            for (size_t k; (k = next++) < work.size(); ) {
+                ids.clear();
+                if (!read_ids(work[k].first.c_str(), ids)) {
+                    fprintf(stderr, "cannot read %s\n",
+                        work[k].first.c_str());
+                    ok = false;
+                    continue; // leaving its output alone
+                }
+                int fd = open(work[k].second.c_str(),
+                    O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                bool done = fd >= 0;
+                if (done) {
+                    done = query_answer(q, ids, fd);
+                    done &= close(fd) == 0;
+                }
+                if (!done) {
+                    fprintf(stderr, "cannot write %s\n",
+                        work[k].second.c_str());
+                    ok = false;
+                }
+            }
+            query_free(q);
+        });
+    }
+    for (thread &t : workers)
+        t.join();
+    if (verbose) {
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        fprintf(stderr, "batch: %zu queries on %zu threads, %.3f s\n",
+            work.size(), workers.size(), elapsed.count());
+    }
+    return ok;
+}
+
+network *read_manifest(const char *manifest) {
+    vector<string> lines, files;
+    if (!read_ids(manifest, lines))
+        return nullptr;
+    string dir(manifest);
+    dir.erase(dir.find_last_of('/') == string::npos ? 0
+        : dir.find_last_of('/') + 1);
+    for (const string &line : lines) {
+        if (line.empty())
+            continue;
+        files.push_back(line[0] == '/' ? line : dir + line);
+    }
+    return files.empty() ? nullptr : network_read(files);
+}